@@ -34,6 +34,7 @@ EggBus::EggBus(){
 void EggBus::init(){
   currentBusNumber  = 0; 
   currentBusAddress = 0;
+  pecEnabled = false;
 }
 
 /*
@@ -131,10 +132,13 @@ void EggBus::i2cWriteAddressRegister(uint8_t slave_address, uint16_t register_ad
   Wire.write(CMD_READ);                        // sends READ command
   Wire.write(high_byte(register_address));     // sends register address high byte
   Wire.write(low_byte(register_address));      // sends register address low byte  
+  if(pecEnabled){
+    Wire.write(crc8(crc8(crc8(0, CMD_READ), high_byte(register_address)), low_byte(register_address)));
+  }
   Wire.endTransmission();                      // stop transmitting    
 }
 
-void EggBus::i2cReadRegisterValue(uint8_t slave_address, uint8_t * buf, uint8_t response_length){
+bool EggBus::i2cReadRegisterValue(uint8_t slave_address, uint8_t * buf, uint8_t response_length){
   
   /* 
     The Nanode then writes the Sensor Modules I2C address to bus with the Write bit set to 1 (SLA+R), 
@@ -142,18 +146,71 @@ void EggBus::i2cReadRegisterValue(uint8_t slave_address, uint8_t * buf, uint8_t
     and finally issues an I2C stop condition.  
   */
   
+  /*
+    with PEC on the module sends a CRC-8 of the response after it, so response_length
+    has to be the exact length of the field. returns false if the CRC doesn't match
+  */
+  
   uint8_t index = 0;
-  Wire.requestFrom(slave_address, response_length);   
+  uint8_t crc = 0;
+  uint8_t data = 0;
+  Wire.requestFrom(slave_address, (uint8_t) (response_length + (pecEnabled ? 1 : 0)));
   while(Wire.available()){    // slave may send less than requested
-    buf[index++] = Wire.read();
-  }  
+    data = Wire.read();
+    if(index < response_length){
+      buf[index] = data;
+      crc = crc8(crc, data);
+    }
+    else if(data != crc){
+      return false;
+    }
+    index++;
+  }
+  
+  return !pecEnabled || index > response_length;
 }
 
-void EggBus::i2cGetValue(uint8_t slave_address, uint16_t register_address, uint8_t response_length){
-  i2cWriteAddressRegister(slave_address, register_address);
-  delay(10); // this is definitely necessary (though shorter may be ok too)
-  i2cReadRegisterValue(slave_address, buffer, response_length);  
-  delay(10); // this may not be necessary
+// the CRC is always appended, a module with PEC off just ignores it
+void EggBus::i2cWriteRegisterValue(uint8_t slave_address, uint16_t register_address, uint32_t value){
+  uint8_t frame[7];
+  uint8_t crc = 0;
+  frame[0] = CMD_WRITE;
+  frame[1] = high_byte(register_address);
+  frame[2] = low_byte(register_address);
+  for(uint8_t ii = 0; ii < 4; ii++){
+    frame[3 + ii] = (value >> (24 - 8 * ii)) & 0xff;   // big endian
+  }
+  
+  Wire.beginTransmission(slave_address);
+  for(uint8_t ii = 0; ii < 7; ii++){
+    Wire.write(frame[ii]);
+    crc = crc8(crc, frame[ii]);
+  }
+  Wire.write(crc);
+  Wire.endTransmission();
+}
+
+// returns false if every try came back with a bad CRC
+bool EggBus::i2cGetValue(uint8_t slave_address, uint16_t register_address, uint8_t response_length){
+  for(uint8_t attempt = 0; attempt < PEC_RETRIES; attempt++){
+    i2cWriteAddressRegister(slave_address, register_address);
+    delay(10); // this is definitely necessary (though shorter may be ok too)
+    bool ok = i2cReadRegisterValue(slave_address, buffer, response_length);
+    delay(10); // this may not be necessary
+    if(ok){
+      return true;
+    }
+  }
+  return false;
+}
+
+// CRC-8 with the SMBus PEC polynomial x^8 + x^2 + x + 1
+uint8_t EggBus::crc8(uint8_t crc, uint8_t data){
+  crc ^= data;
+  for(uint8_t ii = 0; ii < 8; ii++){
+    crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+  }
+  return crc;
 }
 
 uint8_t EggBus::high_byte(uint16_t value){
@@ -196,8 +253,87 @@ void EggBus::i2cBusSwitch(uint8_t busNumber){
   // and if not... maybe try again or something
 }
 
+/*
+  reads length bytes of the memory map starting at register_address in one go,
+  the module carries on through the fields after the first one, each taking up
+  exactly as many bytes as it has addresses (e.g. 16 for the type string, 4 for R0)
+  so buf[n] holds the byte at register_address + n
+  length is limited by the Wire library's buffer (32 bytes)
+  with PEC on the module sends only the first field and its CRC, so length has to be
+  exactly that field's length and no more than MAX_RESPONSE_LENGTH, longer reads are refused
+  returns the number of bytes read
+*/
+uint8_t EggBus::readBlock(uint16_t register_address, uint8_t * buf, uint8_t length){
+  if(pecEnabled && length > MAX_RESPONSE_LENGTH){
+    return 0;
+  }
+  return i2cGetValueRepeatedStart(currentBusAddress, register_address, buf, length);
+}
+
+/*
+  the READ command and the SLA+R in a single transaction, joined by a repeated start
+  instead of a stop, and with no delays since the module has the response ready by the
+  time the address has been written. needs Arduino 1.0.1 or later for endTransmission(false)
+  and module firmware that handles the repeated start (older modules need i2cGetValue)
+*/
+uint8_t EggBus::i2cGetValueRepeatedStart(uint8_t slave_address, uint16_t register_address, uint8_t * buf, uint8_t response_length){
+  uint8_t index = 0;
+  for(uint8_t attempt = 0; attempt < PEC_RETRIES; attempt++){
+    Wire.beginTransmission(slave_address);
+    Wire.write(CMD_READ);                        // sends READ command
+    Wire.write(high_byte(register_address));     // sends register address high byte
+    Wire.write(low_byte(register_address));      // sends register address low byte
+    if(pecEnabled){
+      Wire.write(crc8(crc8(crc8(0, CMD_READ), high_byte(register_address)), low_byte(register_address)));
+    }
+    Wire.endTransmission(false);                 // repeated start rather than stop
+    if(!pecEnabled){
+      Wire.requestFrom(slave_address, response_length);
+      while(Wire.available()){    // slave may send less than requested
+        buf[index++] = Wire.read();
+      }
+      return index;
+    }
+    if(i2cReadRegisterValue(slave_address, buf, response_length)){
+      return response_length;
+    }
+  }
+  return 0;
+}
+
+/*
+  turns CRC-8 packet error checking on or off, if the module supports it
+  with it on every read is checked and retried (up to PEC_RETRIES times) only on a mismatch,
+  and a read is a single field: readBlock returns just the first one
+  returns true if the module has the requested setting afterwards
+*/
+bool EggBus::setPec(bool enable){
+  if(!i2cGetValue(currentBusAddress, METADATA_BASE_OFFSET + METADATA_CAPABILITIES_FIELD_OFFSET, 4)
+      || !(buf_to_value(buffer) & CAPABILITY_PEC)){
+    return !enable;
+  }
+  
+  i2cWriteRegisterValue(currentBusAddress, METADATA_BASE_OFFSET + METADATA_CONFIG_FIELD_OFFSET, enable ? CONFIG_PEC : 0);
+  delay(10);
+  pecEnabled = enable;
+  
+  // reading it back checks both the setting and that the CRCs line up
+  return i2cGetValue(currentBusAddress, METADATA_BASE_OFFSET + METADATA_CONFIG_FIELD_OFFSET, 4)
+      && ((buf_to_value(buffer) & CONFIG_PEC) != 0) == enable;
+}
+
+/*
+  gets the module's snapshot frame in a single transaction, every sensor's computed value,
+  raw ADC value, range, fault flags and heater power from the same pass of its main loop
+  the pointer is only valid until another call that overwrites it (e.g. getSensor*)
+*/
+uint8_t * EggBus::getSnapshot(){
+  i2cGetValueRepeatedStart(currentBusAddress, SNAPSHOT_BASE_OFFSET, buffer, SNAPSHOT_FRAME_LENGTH);
+  return buffer;
+}
+
 void EggBus::getRawValue(uint8_t sensor_index, uint32_t * adc_result, uint32_t * low_side_resistance){
-  i2cGetValue(currentBusAddress, SENSOR_DATA_BASE_OFFSET + sensor_index * SENSOR_DATA_ADDRESS_BLOCK_SIZE + SENSOR_RAW_VALUE_FIELD_OFFSET, 8);
+  i2cGetValue(currentBusAddress, SENSOR_DATA_BASE_OFFSET + sensor_index * SENSOR_DATA_ADDRESS_BLOCK_SIZE + SENSOR_RAW_VALUE_FIELD_OFFSET, 9);
   *adc_result = buf_to_value(buffer);
   *low_side_resistance = buf_to_value(buffer + 4);
 }
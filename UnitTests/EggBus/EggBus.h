@@ -32,17 +32,25 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.  */
 
 #define  MAX_RESPONSE_LENGTH            (16)  
 #define  CMD_READ                       (0x11)
+#define  CMD_WRITE                      (0x33)
+#define  PEC_RETRIES                    (3)
 
 // BASE ADDRESSES
 #define METADATA_BASE_OFFSET             (0)
 #define SENSOR_DATA_BASE_OFFSET          (32)
 #define SENSOR_DATA_ADDRESS_BLOCK_SIZE   (256)      
+#define SNAPSHOT_BASE_OFFSET             (65280)
 #define DEBUG_BASE_OFFSET                (65408)
 
 // METADATA FIELD OFFSETS
 #define METADATA_SENSOR_COUNT_FIELD_OFFSET (0)
 #define METADATA_MODULE_ID_FIELD_OFFSET    (1)
 #define METADATA_VERSION_FIELD_OFFSET      (7)
+#define METADATA_CAPABILITIES_FIELD_OFFSET (11)
+#define METADATA_CONFIG_FIELD_OFFSET       (15)
+
+#define CAPABILITY_PEC                     (0x08)
+#define CONFIG_PEC                         (0x01)
 
 // SENSOR DATA FIELD OFFSETS
 #define SENSOR_TYPE_FIELD_OFFSET                  (0)
@@ -53,6 +61,11 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.  */
 #define SENSOR_RAW_VALUE_FIELD_OFFSET             (44)
 #define SENSOR_RAW_VALUE_SENSED_RESISTANCE_OFFSET (48)
 
+// SNAPSHOT FRAME (version 1, two sensors)
+#define SNAPSHOT_FRAME_LENGTH               (16)
+#define SNAPSHOT_SEQUENCE_OFFSET             (2)
+#define SNAPSHOT_SENSOR_OFFSET(i)            (4 + 6 * (i))
+
 // DEBUG DATA FIELD OFFSETS
 #define DEBUG_NO2_HEATER_V_PLUS              (0)
 #define DEBUG_NO2_HEATER_V_MINUS             (4)
@@ -69,10 +82,14 @@ class EggBus {
   uint8_t currentBusNumber;   // 0, 1, 2 for the three busses implied by the I2C Mux
   uint8_t currentBusAddress;  // 1 .. 127 (0 is reserved on I2C for "general call"
   uint8_t buffer[16];         // storage space for the current address and strings
+  bool pecEnabled;            // responses carry a CRC-8 and writes have to
   
-  void i2cGetValue(uint8_t slave_address, uint16_t register_address, uint8_t response_length);
+  bool i2cGetValue(uint8_t slave_address, uint16_t register_address, uint8_t response_length);
   void i2cWriteAddressRegister(uint8_t slave_address, uint16_t register_address);
-  void i2cReadRegisterValue(uint8_t slave_address, uint8_t * buf, uint8_t response_length);
+  bool i2cReadRegisterValue(uint8_t slave_address, uint8_t * buf, uint8_t response_length);
+  void i2cWriteRegisterValue(uint8_t slave_address, uint16_t register_address, uint32_t value);
+  uint8_t crc8(uint8_t crc, uint8_t data);
+  uint8_t i2cGetValueRepeatedStart(uint8_t slave_address, uint16_t register_address, uint8_t * buf, uint8_t response_length);
   uint8_t high_byte(uint16_t value);
   uint8_t low_byte(uint16_t value);  
   uint32_t buf_to_value(uint8_t * buf);
@@ -89,6 +106,10 @@ class EggBus {
   uint32_t getSensorValue(uint8_t sensorIndex);
   char * getSensorUnits(uint8_t sensorIndex);
   void getRawValue(uint8_t sensor_index, uint32_t * adc_result, uint32_t * low_side_resistance);
+  // with PEC on a block is a single field: length must be that field's exact length (at most MAX_RESPONSE_LENGTH)
+  uint8_t readBlock(uint16_t register_address, uint8_t * buf, uint8_t length);
+  uint8_t * getSnapshot();
+  bool setPec(bool enable);
 };
 
 #endif /*_EGG_BUS_LIB_H */
@@ -6,9 +6,12 @@
  */
 #include <stdint.h>
 #include <avr/io.h>
-#define __DELAY_BACKWARD_COMPATIBLE__
-#include <util/delay.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
 #include "adc.h"
+#include "scheduler.h"
+#include "timer.h"
 
 #ifndef cbi
 #define cbi(sfr, bit) (_SFR_BYTE(sfr) &= ~_BV(bit))
@@ -18,54 +21,261 @@
 #define sbi(sfr, bit) (_SFR_BYTE(sfr) |= _BV(bit))
 #endif
 
-/* this implementation follows the guidance of
- * Atmel App Note AVR125 Section 3.1 Single conversion
- * some of the code particulars are borrowed from arduino source code */
+#if ADC_MAX_SEQUENCE_LENGTH > 8
+#error "the positions due for a conversion are kept as bits of a byte"
+#endif
+
+#define ADC_PRESCALER            8
+#define ADC_MICROS_PER_CLOCK     (ADC_PRESCALER * 1000000L / F_CPU)
+#define ADC_CONVERSION_CLOCKS    13
+#define ADC_FIRST_CONVERSION_CLOCKS 25 // the first one after the ADC is switched on also initializes the analog circuitry
+#define ADC_NOT_CONVERTING       0xff
+
+/* the conversion engine: the sequence holds every channel the firmware converts, each with a
+ * ring of its latest samples. the heater control and the sampler both read from the same rings.
+ * a position gets converted when it is due, the ADC_vect ISR stores the result and starts the next
+ * position that is due, and once none are the ADC sits idle with no more interrupts. positions
+ * fall due two ways, which is what bounds the conversion rate:
+ *   adc_run_sequence, a scheduler task, makes every position due once per period
+ *   analogRead makes its own channel due, so the sampler gets back to back conversions
+ *   of its sensor only for as long as it waits on them */
+typedef struct{
+    uint16_t samples[ADC_RING_DEPTH];
+    uint8_t  written;   // samples stored so far, zero only until the first, the newest is at (written - 1) % ADC_RING_DEPTH
+} adc_ring_t;
+
+static adc_ring_t adc_rings[ADC_MAX_SEQUENCE_LENGTH];
+static uint8_t adc_sequence[ADC_MAX_SEQUENCE_LENGTH];
+static uint8_t adc_sequence_length = 0;
+static volatile uint8_t adc_due = 0;                        // a bit per sequence position
+static volatile uint8_t adc_converting = ADC_NOT_CONVERTING; // the position the running conversion is for
+static uint8_t adc_last_position = 0xff;                     // where the round robin over the due positions carries on from
+static volatile uint8_t adc_conversion_mode = ADC_CONVERSION_MODE_DEFAULT;
+static volatile uint8_t adc_conversion_clocks = ADC_FIRST_CONVERSION_CLOCKS;
+
+static uint8_t adc_find_position(uint8_t channel_num);
+static uint8_t adc_next_written(uint8_t written);
+static void adc_select_position(uint8_t position);
+static void adc_start_next(void);
+static void adc_wait_for_sample(uint8_t position, uint8_t target);
+
+/* channels are the ones the engine converts, in sequence order, duplicates only get one ring.
+ * their digital input buffers only burn current, asleep or not, so they get switched off
+ * (ADC6 and ADC7 don't have one). the ADC stays on from here, the stream never stops for long */
+void adc_init(const uint8_t * channels, uint8_t num_channels){
+    for(uint8_t ii = 0; ii < num_channels; ii++){
+        if(adc_find_position(channels[ii]) == ADC_NOT_IN_SEQUENCE && adc_sequence_length < ADC_MAX_SEQUENCE_LENGTH){
+            adc_sequence[adc_sequence_length++] = channels[ii];
+        }
+        if(channels[ii] < 6){
+            DIDR0 |= _BV(ADC0D + channels[ii]);
+        }
+    }
+
+    // ADC on with its interrupt, the 1MHz system clock prescaled by 8 gives a 125kHz ADC clock
+    PRR &= ~_BV(PRADC);
+    ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS1) | _BV(ADPS0);
+    adc_conversion_clocks = ADC_FIRST_CONVERSION_CLOCKS;
+}
+
+/* the scheduler's ADC task, one conversion of every channel in the sequence each period.
+ * in idle mode the ISR works through them while the CPU gets on with other things, in noise reduction
+ * mode the CPU has to be asleep for each of them anyway so they are done right here, one after the other */
+void adc_run_sequence(void){
+    if(adc_conversion_mode == ADC_CONVERSION_NOISE_REDUCTION){
+        for(uint8_t ii = 0; ii < adc_sequence_length; ii++){
+            analogRead(adc_sequence[ii]);
+        }
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        adc_due = (1 << adc_sequence_length) - 1;
+        if(adc_converting == ADC_NOT_CONVERTING){
+            adc_start_next();
+        }
+    }
+}
+
+/* in noise reduction mode the CPU and the I/O clock are stopped while a conversion runs,
+ * which takes the digital switching noise out of the result so fewer samples need averaging.
+ * Timer0 stops along with the I/O clock, analogRead gives the timer back whatever part of the
+ * conversion it slept through so timer_millis, the settle timeout and the task periods don't drift */
+void adc_set_conversion_mode(uint8_t mode){
+    adc_conversion_mode = mode;
+}
+
+uint8_t adc_get_conversion_mode(void){
+    return adc_conversion_mode;
+}
+
+/* returns the next sample the engine takes on the channel, from a conversion that started after
+ * the call, so it is safe to use right after switching a divider. channels outside the sequence read as 0
+ * main loop only and with interrupts on, from an ISR it would wait forever */
 uint16_t analogRead(uint8_t channel_num){
-    uint8_t high = 0, low = 0;
+    uint8_t position = adc_find_position(channel_num);
+    uint8_t target = 0;
+    uint16_t ret = 0;
+
+    if(position == ADC_NOT_IN_SEQUENCE){
+        return 0;
+    }
 
-    // the following evaluates to ADMUX & 0xF0
-    uint8_t temp = ADMUX & ~(_BV(MUX0) | _BV(MUX1) | _BV(MUX2) | _BV(MUX3)); // ADMUX with the MUX bits cleared
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        // a conversion already running on the channel was sampled before the call, wait for the one after it
+        target = adc_next_written(adc_rings[position].written);
+        if(adc_converting == position){
+            target = adc_next_written(target);
+        }
+        adc_due |= _BV(position);
+    }
 
-    // Set the Mux bitfield (MUX3:0) in ADC’s MUX register (ADMUX)
-    // channel num should be in the range of 0 .. 8, but not checked
-    // the following evaluates to channel & 0x0F
-    temp |= channel_num & (_BV(MUX0) | _BV(MUX1) | _BV(MUX2) | _BV(MUX3));   // makes sure we don't affect other register bits
+    adc_wait_for_sample(position, target);
 
-    // Set the Voltage Reference bitfield (REFS0) to select AVcc reference
-    temp |= _BV(REFS0);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        ret = adc_rings[position].samples[(uint8_t) (target - 1) & (ADC_RING_DEPTH - 1)];
+    }
+    return ret;
+}
 
-    ADMUX = temp; // write the prescribed value back to the register
+/* the mean of the channel's last ADC_RING_DEPTH samples from the stream, without converting anything
+ * unless the channel has never been converted at all. main loop only */
+uint16_t adc_get_average(uint8_t channel_num){
+    uint8_t position = adc_find_position(channel_num);
+    uint16_t ret = 0;
 
-    // Set the ADC Prescaler  bitfield (ADPS2:0) in ADCSRA equal to 100 to prescale system clock by 8.
-    // By default, the successive approximation circuitry requires an input clock frequency between 50
-    // kHz and 200 kHz to get maximum resolution, per the ATtin48 datasheet.
-    // Since we're assuming running @ 1MHz, 1MHz/8 = 125kHz is in the required range
-    // the following evaluates to ADCSRA & 0xF8
-    temp = ADCSRA & ~(_BV(ADPS0) | _BV(ADPS1) | _BV(ADPS2));
+    if(position == ADC_NOT_IN_SEQUENCE){
+        return 0;
+    }
 
-    // choose the channel requested
-    temp |= channel_num & (_BV(ADPS0) | _BV(ADPS1) | _BV(ADPS2)); // prevent the channel num from affecting other bits
+    // the first sample fills the whole ring, so from then on there are always ADC_RING_DEPTH to average
+    if(adc_rings[position].written == 0){
+        analogRead(channel_num);
+    }
 
-    // enable the ADC
-    temp |= _BV(ADEN);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        for(uint8_t ii = 0; ii < ADC_RING_DEPTH; ii++){
+            ret += adc_rings[position].samples[ii];
+        }
+    }
+    return (ret + ADC_RING_DEPTH / 2) / ADC_RING_DEPTH;
+}
 
-    ADCSRA = temp; // write the prescribed value back to the register
+static uint8_t adc_find_position(uint8_t channel_num){
+    for(uint8_t ii = 0; ii < adc_sequence_length; ii++){
+        if(adc_sequence[ii] == channel_num){
+            return ii;
+        }
+    }
+    return ADC_NOT_IN_SEQUENCE;
+}
 
-    sbi(ADCSRA, ADSC); // start the conversion
+// wrapping to ADC_RING_DEPTH rather than to zero keeps the ring position and the meaning of zero
+static uint8_t adc_next_written(uint8_t written){
+    return written == 0xff ? ADC_RING_DEPTH : written + 1;
+}
 
-    // Wait for the  Interrupt Flag  bit (ADIF) in ADCSRA to be set, indicating that the conversion is finished
-    // ADSC is cleared when the conversion finishes
-    while (bit_is_set(ADCSRA, ADSC));
+// interrupts off, the conversion starts with ADSC or by going to sleep in noise reduction mode
+static void adc_select_position(uint8_t position){
+    adc_due &= ~_BV(position);
+    adc_converting = position;
+    adc_last_position = position;
 
-    // we have to read ADCL first; doing so locks both ADCL
-    // and ADCH until ADCH is read.  reading ADCL second would
-    // cause the results of each conversion to be discarded,
-    // as ADCL and ADCH would be locked when it completed.
-    low  = ADCL;
-    high = ADCH;
+    // AVcc reference, right adjusted result, only the MUX bits change
+    ADMUX = _BV(REFS0) | (adc_sequence[position] & (_BV(MUX0) | _BV(MUX1) | _BV(MUX2) | _BV(MUX3)));
+}
 
-    return (high << 8) | low;
+// interrupts off, starts the first due position after the last one converted
+static void adc_start_next(void){
+    uint8_t position = adc_last_position;
+
+    for(uint8_t ii = 0; ii < adc_sequence_length; ii++){
+        if(++position >= adc_sequence_length){
+            position = 0;
+        }
+        if(adc_due & _BV(position)){
+            adc_select_position(position);
+            sbi(ADCSRA, ADSC);
+            return;
+        }
+    }
 }
 
+static void adc_wait_for_sample(uint8_t position, uint8_t target){
+    uint8_t noise_reduction_started = 0;
+    uint16_t conversion_us = 0;
+    uint32_t start_us = 0;
+    uint32_t awake_us = 0;
+
+    for(;;){
+        cli();
+        if((uint8_t) (adc_rings[position].written - target) < 0x80){
+            sei();
+            break;
+        }
+
+        // If a conversion is running, whoever started it, or some other interrupt (e.g. TWI) woke us up
+        // in the middle of ours, only idle until its interrupt comes in. Otherwise either entering
+        // ADC noise reduction mode starts our conversion, or the next due one gets started here.
+        if(adc_converting != ADC_NOT_CONVERTING){
+            set_sleep_mode(SLEEP_MODE_IDLE);
+        }
+        else if(adc_conversion_mode == ADC_CONVERSION_NOISE_REDUCTION){
+            adc_select_position(position);
+            conversion_us = adc_conversion_clocks * ADC_MICROS_PER_CLOCK;
+            start_us = timer_micros();
+            noise_reduction_started = 1;
+            set_sleep_mode(SLEEP_MODE_ADC);
+        }
+        else{
+            adc_start_next();
+            set_sleep_mode(SLEEP_MODE_IDLE);
+        }
+
+        // sei takes effect after the next instruction, so no interrupt can sneak in
+        // between the check above and going to sleep
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
 
+    /* Timer0 only saw the part of the conversion where some other interrupt (e.g. TWI)
+     * had woken the CPU up, the rest of it was spent in noise reduction sleep */
+    if(noise_reduction_started){
+        awake_us = timer_micros() - start_us;
+        if(awake_us < conversion_us){
+            timer_add_micros(conversion_us - awake_us);
+        }
+    }
+}
+
+ISR(ADC_vect){
+    uint8_t low  = ADCL; // ADCL first, it locks ADCH until ADCH is read
+    uint8_t high = ADCH;
+    uint16_t sample = (high << 8) | low;
+    adc_ring_t * ring = 0;
+
+    SCHEDULER_NOTE_WAKE(SCHEDULER_WAKE_ADC);
+
+    if(adc_converting == ADC_NOT_CONVERTING){
+        return;
+    }
+
+    ring = &adc_rings[adc_converting];
+    if(ring->written == 0){
+        for(uint8_t ii = 1; ii < ADC_RING_DEPTH; ii++){
+            ring->samples[ii] = sample;
+        }
+    }
+    ring->samples[ring->written & (ADC_RING_DEPTH - 1)] = sample;
+    ring->written = adc_next_written(ring->written);
+
+    adc_converting = ADC_NOT_CONVERTING;
+    adc_conversion_clocks = ADC_CONVERSION_CLOCKS;
+
+    // in noise reduction mode conversions only start from the sleep
+    if(adc_conversion_mode == ADC_CONVERSION_IDLE){
+        adc_start_next();
+    }
+}
@@ -10,7 +10,23 @@
 
 #include <stdint.h>
 
-uint16_t analogRead(uint8_t channel_num);
+#define ADC_MAX_SEQUENCE_LENGTH    6  // distinct channels the conversion engine keeps samples for, at most 8
+#define ADC_RING_DEPTH             4  // samples kept per channel, must be a power of two
+#define ADC_NOT_IN_SEQUENCE        0xff
+
+// conversion modes, either way the CPU sleeps while a conversion runs
+#define ADC_CONVERSION_IDLE            0  // the ADC ISR starts the next conversion that is due and the CPU idles
+#define ADC_CONVERSION_NOISE_REDUCTION 1  // going to sleep in ADC noise reduction mode starts each conversion
 
+#ifndef ADC_CONVERSION_MODE_DEFAULT
+#define ADC_CONVERSION_MODE_DEFAULT ADC_CONVERSION_IDLE
+#endif
+
+void adc_init(const uint8_t * channels, uint8_t num_channels);
+void adc_run_sequence(void);
+uint16_t analogRead(uint8_t channel_num);
+uint16_t adc_get_average(uint8_t channel_num);
+void adc_set_conversion_mode(uint8_t mode);
+uint8_t adc_get_conversion_mode(void);
 
 #endif /* ADC_H_ */
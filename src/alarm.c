@@ -0,0 +1,122 @@
+/*
+ * alarm.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+#include "alarm.h"
+#include "egg_bus.h"
+#include "utility.h"
+
+/* lets the master sleep until there is something to read instead of polling, the alert line
+ * is pulled low for as long as any sensor has a latched status bit that its config enables */
+static uint32_t alarm_threshold[EGG_BUS_NUM_HOSTED_SENSORS];
+static uint8_t alarm_config[EGG_BUS_NUM_HOSTED_SENSORS];
+static uint8_t alarm_status[EGG_BUS_NUM_HOSTED_SENSORS];
+
+// zero until the first sample tells us which side of the threshold the sensor is on
+static uint8_t alarm_primed[EGG_BUS_NUM_HOSTED_SENSORS];
+
+// call with interrupts off, or from an ISR
+static void alarm_update_line(void){
+    uint8_t pending = 0;
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        pending |= alarm_status[ii] & alarm_config[ii];
+    }
+
+    if(pending & ALARM_LATCH_MASK){
+        ALERT_ASSERT();
+    }
+    else{
+        ALERT_RELEASE();
+    }
+}
+
+void alarm_init(void){
+    ALERT_INIT();
+}
+
+// called by the sampler every time it publishes a sample, main loop only
+void alarm_on_sample(uint8_t sensor_index, uint32_t value){
+    uint8_t latch = ALARM_DATA_READY;
+    uint8_t above = 0;
+
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        above = value >= alarm_threshold[sensor_index] ? ALARM_ABOVE_THRESHOLD : 0;
+        if(alarm_primed[sensor_index] && above != (alarm_status[sensor_index] & ALARM_ABOVE_THRESHOLD)){
+            latch |= above ? ALARM_CROSSED_ABOVE : ALARM_CROSSED_BELOW;
+        }
+        alarm_primed[sensor_index] = 1;
+
+        alarm_status[sensor_index] = (alarm_status[sensor_index] & ALARM_LATCH_MASK) | latch | above;
+        alarm_update_line();
+    }
+}
+
+// the side of the threshold is worked out again from the next sample, so changing it doesn't count as a crossing
+void alarm_set_threshold(uint8_t sensor_index, uint32_t threshold){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        alarm_threshold[sensor_index] = threshold;
+        alarm_primed[sensor_index] = 0;
+    }
+}
+
+uint32_t alarm_get_threshold(uint8_t sensor_index){
+    uint32_t ret = 0;
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return 0;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        ret = alarm_threshold[sensor_index];
+    }
+    return ret;
+}
+
+void alarm_set_config(uint8_t sensor_index, uint8_t config){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        alarm_config[sensor_index] = config & ALARM_LATCH_MASK;
+        alarm_update_line();
+    }
+}
+
+uint8_t alarm_get_config(uint8_t sensor_index){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return 0;
+    }
+    return alarm_config[sensor_index];
+}
+
+uint8_t alarm_get_status(uint8_t sensor_index){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return 0;
+    }
+    return alarm_status[sensor_index];
+}
+
+// clears the latched bits that are set in mask, and releases the alert line if nothing else holds it
+void alarm_clear_status(uint8_t sensor_index, uint8_t mask){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        alarm_status[sensor_index] &= ~(mask & ALARM_LATCH_MASK);
+        alarm_update_line();
+    }
+}
@@ -0,0 +1,29 @@
+/*
+ * alarm.h
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef ALARM_H_
+#define ALARM_H_
+
+#include <stdint.h>
+
+// status bits, latched until the master writes them back as ones, the same bits in the config enable the alert line for them
+#define ALARM_DATA_READY        0x01  // a new sample was published
+#define ALARM_CROSSED_ABOVE     0x02  // the computed value went from below the threshold to at or above it
+#define ALARM_CROSSED_BELOW     0x04  // the computed value went from at or above the threshold to below it
+#define ALARM_LATCH_MASK        (ALARM_DATA_READY | ALARM_CROSSED_ABOVE | ALARM_CROSSED_BELOW)
+// status only, not latched: the last computed value was at or above the threshold
+#define ALARM_ABOVE_THRESHOLD   0x80
+
+void alarm_init(void);
+void alarm_on_sample(uint8_t sensor_index, uint32_t value);
+void alarm_set_threshold(uint8_t sensor_index, uint32_t threshold);
+uint32_t alarm_get_threshold(uint8_t sensor_index);
+void alarm_set_config(uint8_t sensor_index, uint8_t config);
+uint8_t alarm_get_config(uint8_t sensor_index);
+uint8_t alarm_get_status(uint8_t sensor_index);
+void alarm_clear_status(uint8_t sensor_index, uint8_t mask);
+
+#endif /* ALARM_H_ */
@@ -0,0 +1,76 @@
+/*
+ * command_queue.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <stdint.h>
+#include "command_queue.h"
+
+/* single producer (the TWI ISR) and single consumer (the main loop), so no locking:
+ * only the producer moves the head and only the consumer moves the tail, both are
+ * single bytes so they are read and written in one go. they count up freely and
+ * wrap, head - tail is the number of commands waiting */
+static command_t command_queue[COMMAND_QUEUE_LENGTH];
+static volatile uint8_t command_queue_head = 0;
+static volatile uint8_t command_queue_tail = 0;
+
+// only touched by the producer
+static uint8_t command_queue_high_water = 0;
+static uint32_t command_queue_overflow_count = 0;
+
+// keeps the compiler from moving the entry copy past the index update that hands it over
+#define COMMAND_QUEUE_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+// producer side, returns zero and counts an overflow if the queue is full
+uint8_t command_queue_push(uint16_t address, uint32_t value){
+    uint8_t head = command_queue_head;
+    uint8_t depth = head - command_queue_tail;
+    command_t * command = &command_queue[head & (COMMAND_QUEUE_LENGTH - 1)];
+
+    if(depth >= COMMAND_QUEUE_LENGTH){
+        command_queue_overflow_count++;
+        return 0;
+    }
+
+    command->address = address;
+    command->value = value;
+    COMMAND_QUEUE_BARRIER();
+    command_queue_head = head + 1;
+
+    if(depth + 1 > command_queue_high_water){
+        command_queue_high_water = depth + 1;
+    }
+
+    return 1;
+}
+
+// consumer side, returns zero if there is nothing waiting
+uint8_t command_queue_pop(command_t * command){
+    uint8_t tail = command_queue_tail;
+
+    if(tail == command_queue_head){
+        return 0;
+    }
+
+    COMMAND_QUEUE_BARRIER();
+    *command = command_queue[tail & (COMMAND_QUEUE_LENGTH - 1)];
+    COMMAND_QUEUE_BARRIER();
+    command_queue_tail = tail + 1;
+
+    return 1;
+}
+
+uint8_t command_queue_get_depth(void){
+    return command_queue_head - command_queue_tail;
+}
+
+// the most commands that have been waiting at once
+uint8_t command_queue_get_high_water(void){
+    return command_queue_high_water;
+}
+
+// writes dropped because the queue was full
+uint32_t command_queue_get_overflow_count(void){
+    return command_queue_overflow_count;
+}
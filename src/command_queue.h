@@ -0,0 +1,32 @@
+/*
+ * command_queue.h
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef COMMAND_QUEUE_H_
+#define COMMAND_QUEUE_H_
+
+#include <stdint.h>
+
+// writes waiting for the main loop, 6 bytes of RAM each, has to be a power of two
+#ifndef COMMAND_QUEUE_LENGTH
+#define COMMAND_QUEUE_LENGTH    4
+#endif
+#if (COMMAND_QUEUE_LENGTH & (COMMAND_QUEUE_LENGTH - 1)) != 0 || COMMAND_QUEUE_LENGTH > 128
+#error "COMMAND_QUEUE_LENGTH has to be a power of two up to 128"
+#endif
+
+// a register write that is too slow, or changes too much, to be done in the TWI ISR
+typedef struct{
+    uint16_t address;
+    uint32_t value;
+} command_t;
+
+uint8_t command_queue_push(uint16_t address, uint32_t value);
+uint8_t command_queue_pop(command_t * command);
+uint8_t command_queue_get_depth(void);
+uint8_t command_queue_get_high_water(void);
+uint32_t command_queue_get_overflow_count(void);
+
+#endif /* COMMAND_QUEUE_H_ */
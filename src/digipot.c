@@ -6,10 +6,33 @@
  */
 
 #include <avr/io.h>
+#include <util/atomic.h>
 #include "digipot.h"
 #include "spi.h"
 #include "utility.h"
 
+// what the wipers are set to, so nobody has to ask the part over SPI
+static uint16_t digipot_wiper[2];
+// the status register as of the last digipot_refresh_status, for the same reason
+static uint16_t digipot_status = 0;
+
+// the shadow index for a wiper address
+#define DIGIPOT_WIPER_INDEX(wiper_num) ((wiper_num) == DIGIPOT_ADR_WIPER1 ? 1 : 0)
+
+// main loop only, the TWI ISR reads the shadow so it gets updated in one go
+static void digipot_set_shadow(uint8_t wiper_num, int16_t value){
+    if(value < 0){
+        value = 0;
+    }
+    else if(value > DIGIPOT_WIPER_MAX){
+        value = DIGIPOT_WIPER_MAX;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        digipot_wiper[DIGIPOT_WIPER_INDEX(wiper_num)] = value;
+    }
+}
+
 void digipot_select_slave(){
     DIGIPOT_SLAVE_SELECT_PORT &= ~_BV(DIGIPOT_SLAVE_SELECT_PIN);
 }
@@ -22,6 +45,24 @@ void digipot_init(){
     // set the slave select pin to an output high
     DIGIPOT_SLAVE_SELECT_DDR |= _BV(DIGIPOT_SLAVE_SELECT_PIN);
     DIGIPOT_SLAVE_SELECT_PORT |= _BV(DIGIPOT_SLAVE_SELECT_PIN);
+
+    // start the shadow off with wherever the part powered up, spi_begin has to have been called
+    digipot_set_shadow(DIGIPOT_WIPER0, digipot_read_wiper0());
+    digipot_set_shadow(DIGIPOT_WIPER1, digipot_read_wiper1());
+    digipot_refresh_status();
+}
+
+// reads the status register into its shadow over SPI, main loop only
+void digipot_refresh_status(void){
+    uint16_t status = digipot_read_status();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        digipot_status = status;
+    }
+}
+
+// the status register from the shadow, fine to call from the TWI ISR
+uint16_t digipot_get_status(void){
+    return digipot_status;
 }
 
 void digipot_increment(uint8_t wiper_num, uint8_t n){
@@ -33,6 +74,9 @@ void digipot_increment(uint8_t wiper_num, uint8_t n){
     for(uint8_t i = 0; i < n; i++){
         digipot_write(cmd);
     }
+
+    // the part stops at full scale, so does the shadow
+    digipot_set_shadow(wiper_num, (int16_t) digipot_wiper[DIGIPOT_WIPER_INDEX(wiper_num)] + n);
 }
 
 void digipot_decrement(uint8_t wiper_num, uint8_t n){
@@ -44,6 +88,27 @@ void digipot_decrement(uint8_t wiper_num, uint8_t n){
     for(uint8_t i = 0; i < n; i++){
         digipot_write(cmd);
     }
+
+    digipot_set_shadow(wiper_num, (int16_t) digipot_wiper[DIGIPOT_WIPER_INDEX(wiper_num)] - n);
+}
+
+// sets the wiper in one 16-bit write command however far it has to go
+void digipot_write_wiper(uint8_t wiper_num, uint16_t value){
+    if(value > DIGIPOT_WIPER_MAX){
+        value = DIGIPOT_WIPER_MAX;
+    }
+
+    digipot_select_slave();
+    spi_transfer(DIGIPOT_CMD_WRITE | DIGIPOT_ADR_VOLATILE | (wiper_num & DIGIPOT_ADR_WIPER1) | (value >> 8));
+    spi_transfer(value & 0xFF);
+    digipot_deselect_slave();
+
+    digipot_set_shadow(wiper_num, value);
+}
+
+// the wiper setting from the shadow, no SPI involved so it is fine to call from the TWI ISR
+uint16_t digipot_get_wiper(uint8_t wiper_num){
+    return digipot_wiper[DIGIPOT_WIPER_INDEX(wiper_num)];
 }
 
 void digipot_write(uint8_t cmd_byte)
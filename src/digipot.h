@@ -13,6 +13,7 @@
 #define DIGIPOT_SLAVE_SELECT_PORT PORTD
 #define DIGIPOT_SLAVE_SELECT_PIN  2
 
+#define DIGIPOT_CMD_WRITE     0x00 //B00000000
 #define DIGIPOT_CMD_READ      0x0C //B00001100
 #define DIGIPOT_CMD_INCREMENT 0x04 //B00000100
 #define DIGIPOT_CMD_DECREMENT 0x08 //B00001000
@@ -23,6 +24,11 @@
 #define DIGIPOT_WIPER0        DIGIPOT_ADR_WIPER0
 #define DIGIPOT_WIPER1        DIGIPOT_ADR_WIPER1
 
+// full scale on the 8-bit parts, 128 on the 7-bit ones
+#ifndef DIGIPOT_WIPER_MAX
+#define DIGIPOT_WIPER_MAX     256
+#endif
+
 void digipot_select_slave();
 void digipot_deselect_slave();
 void digipot_write(uint8_t data_byte);
@@ -30,8 +36,12 @@ void digipot_write(uint8_t data_byte);
 void digipot_init();
 void digipot_increment(uint8_t wiper_num, uint8_t n);
 void digipot_decrement(uint8_t wiper_num, uint8_t n);
+void digipot_write_wiper(uint8_t wiper_num, uint16_t value);
+uint16_t digipot_get_wiper(uint8_t wiper_num);
 uint16_t digipot_read_wiper0();
 uint16_t digipot_read_wiper1();
 uint16_t digipot_read_status();
+void digipot_refresh_status(void);
+uint16_t digipot_get_status(void);
 
 #endif /* DIGIPOT_H_ */
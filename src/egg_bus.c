@@ -8,31 +8,42 @@
 #include <stdint.h>
 #include <avr/pgmspace.h>
 #include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <util/atomic.h>
 #include "egg_bus.h"
 #include "utility.h"
 
 static uint16_t egg_bus_read_address = 0;
-static uint8_t egg_bus_sensor_mapping_table[] = {
+static uint8_t egg_bus_config = 0;
+static uint32_t egg_bus_pec_error_count = 0;
+static const uint8_t egg_bus_sensor_mapping_table[] PROGMEM = {
         0, // index 0 [NO2] is on ADC0
         2, // index 1 [CO] is on  ADC2
 };
 
-char egg_bus_sensor_type_0[] PROGMEM = "NO2";
-char egg_bus_sensor_type_1[] PROGMEM = "CO";
-PGM_P egg_bus_sensor_types[] PROGMEM = {
+const char egg_bus_sensor_type_0[] PROGMEM = "NO2";
+const char egg_bus_sensor_type_1[] PROGMEM = "CO";
+PGM_P const egg_bus_sensor_types[] PROGMEM = {
         egg_bus_sensor_type_0,
         egg_bus_sensor_type_1
 };
 
-char egg_bus_sensor_units_0[] PROGMEM = "ppb";
-char egg_bus_sensor_units_1[] PROGMEM = "ppb";
-PGM_P egg_bus_sensor_units[] PROGMEM = {
+const char egg_bus_sensor_units_0[] PROGMEM = "ppb";
+const char egg_bus_sensor_units_1[] PROGMEM = "ppb";
+PGM_P const egg_bus_sensor_units[] PROGMEM = {
         egg_bus_sensor_units_0,
         egg_bus_sensor_units_1
 };
 
 uint32_t EEMEM egg_bus_sensor_r0[EGG_BUS_NUM_HOSTED_SENSORS]  = { 2200, 750000 }; // values in ohms
 
+// what the EEPROM holds, so reads never have to wait on it
+static uint32_t egg_bus_sensor_r0_shadow[EGG_BUS_NUM_HOSTED_SENSORS];
+
+void egg_bus_init(void){
+    eeprom_read_block((void *) egg_bus_sensor_r0_shadow, (const void *) egg_bus_sensor_r0, sizeof(egg_bus_sensor_r0_shadow));
+}
+
 uint16_t egg_bus_get_read_address(){
     return egg_bus_read_address;
 }
@@ -44,25 +55,70 @@ void egg_bus_set_read_address(uint16_t read_address){
 uint8_t egg_bus_map_to_analog_pin(uint8_t sensor_index){
     uint8_t analog_pin_number = 0;
     if(sensor_index < EGG_BUS_NUM_HOSTED_SENSORS){
-        analog_pin_number = egg_bus_sensor_mapping_table[sensor_index];
+        analog_pin_number = pgm_read_byte(&egg_bus_sensor_mapping_table[sensor_index]);
     }
     return analog_pin_number;
 }
 
-void egg_bus_get_sensor_type(uint8_t sensor_index, char * target_buffer){
-    strcpy_P(target_buffer, (PGM_P)pgm_read_word(&(egg_bus_sensor_types[sensor_index])));
+// the strings stay in flash, these return where
+const char * egg_bus_get_sensor_type_P(uint8_t sensor_index){
+    return (PGM_P)pgm_read_word(&(egg_bus_sensor_types[sensor_index]));
 }
 
-void egg_bus_get_sensor_units(uint8_t sensor_index, char * target_buffer){
-    strcpy_P(target_buffer, (PGM_P)pgm_read_word(&(egg_bus_sensor_units[sensor_index])));
+const char * egg_bus_get_sensor_units_P(uint8_t sensor_index){
+    return (PGM_P)pgm_read_word(&(egg_bus_sensor_units[sensor_index]));
 }
 
+// only the main loop changes it, and not with the TWI ISR able to get in halfway
 uint32_t egg_bus_get_r0_ohms(uint8_t sensor_index){
-    uint32_t ret_value = 0;
-    eeprom_read_block (( void *) &ret_value , ( const void *) (&egg_bus_sensor_r0[sensor_index]) , 4) ;
-    return ret_value;
+    return egg_bus_sensor_r0_shadow[sensor_index];
 }
 
+// blocks for several milliseconds per byte on the EEPROM write, main loop only
 void egg_bus_set_r0_ohms(uint8_t sensor_index, uint32_t value){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        egg_bus_sensor_r0_shadow[sensor_index] = value;
+    }
     eeprom_write_block(&value, &egg_bus_sensor_r0[sensor_index], 4);
 }
+
+uint8_t egg_bus_get_config(void){
+    return egg_bus_config;
+}
+
+void egg_bus_set_config(uint8_t config){
+    egg_bus_config = config & EGG_BUS_CONFIG_PEC;
+}
+
+// one more byte into a CRC-8 with the SMBus PEC polynomial
+uint8_t egg_bus_crc8_update(uint8_t crc, uint8_t data){
+    return _crc8_ccitt_update(crc, data);
+}
+
+// CRC-8 with the SMBus PEC polynomial, starting from zero
+uint8_t egg_bus_crc8(const uint8_t * buffer, uint8_t length){
+    uint8_t crc = 0;
+    for(uint8_t ii = 0; ii < length; ii++){
+        crc = _crc8_ccitt_update(crc, buffer[ii]);
+    }
+    return crc;
+}
+
+/* returns non-zero if a received frame can be acted on, with PEC on its last byte
+ * has to be the CRC of the rest, anything else gets counted and should be dropped */
+uint8_t egg_bus_check_pec(const uint8_t * frame, uint8_t length){
+    if(!(egg_bus_config & EGG_BUS_CONFIG_PEC)){
+        return 1;
+    }
+
+    if(length >= 2 && egg_bus_crc8(frame, length - 1) == frame[length - 1]){
+        return 1;
+    }
+
+    egg_bus_pec_error_count++;
+    return 0;
+}
+
+uint32_t egg_bus_get_pec_error_count(void){
+    return egg_bus_pec_error_count;
+}
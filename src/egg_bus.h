@@ -13,9 +13,13 @@
 #define EGG_BUS_COMMAND_READ        0x11
 #define EGG_BUS_COMMAND_WRITE       0x33
 
+// command, address high, address low, then for a write the 4 value bytes (with PEC on the CRC comes on top)
+#define EGG_BUS_READ_FRAME_LENGTH   3
+#define EGG_BUS_WRITE_FRAME_LENGTH  7
+
 #define EGG_BUS_NUM_HOSTED_SENSORS  2
 
-#define EGG_BUS_MAX_RESPONSE_LENGTH 16
+#define EGG_BUS_MAX_RESPONSE_LENGTH 18 // the snapshot frame, the longest field that gets built in the response buffer
 
 /* Sensor Module Memory Map Definition */
 
@@ -25,6 +29,22 @@
 #define EGG_BUS_ADDRESS_SENSOR_COUNT      0
 #define EGG_BUS_ADDRESS_MODULE_ID         1
 #define EGG_BUS_FIRMWARE_VERSION          7
+#define EGG_BUS_CAPABILITIES              11
+#define EGG_BUS_CONFIG                    15
+#define EGG_BUS_PEC_ERROR_COUNT           19
+#define EGG_BUS_COMMAND_QUEUE_STATUS      23 // depth, high water mark, capacity, 0
+#define EGG_BUS_COMMAND_QUEUE_OVERFLOW_COUNT 27
+
+// capability flags, what this firmware can do
+#define EGG_BUS_CAPABILITY_STREAMING      0x01 // reads carry on through the register map
+#define EGG_BUS_CAPABILITY_REPEATED_START 0x02 // READ command and SLA+R in one transaction
+#define EGG_BUS_CAPABILITY_SNAPSHOT       0x04 // snapshot frame at EGG_BUS_SNAPSHOT_FRAME
+#define EGG_BUS_CAPABILITY_PEC            0x08 // CRC-8 packet error checking, see EGG_BUS_CONFIG_PEC
+#define EGG_BUS_CAPABILITIES_VALUE        (EGG_BUS_CAPABILITY_STREAMING | EGG_BUS_CAPABILITY_REPEATED_START \
+                                           | EGG_BUS_CAPABILITY_SNAPSHOT | EGG_BUS_CAPABILITY_PEC)
+
+// config flags
+#define EGG_BUS_CONFIG_PEC                0x01 // CRC-8 (x^8 + x^2 + x + 1, as SMBus PEC) after every response, and required at the end of every write
 
 // Sensor Block Definitions
 #define EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS             32
@@ -38,6 +58,38 @@
 #define EGG_BUS_SENSOR_BLOCK_TABLE_Y_SCALER_OFFSET    48
 #define EGG_BUS_SENSOR_BLOCK_MEASURED_INDEPENDENT_SCALER_OFFSET 52
 #define EGG_BUS_SENSOR_BLOCK_COMPUTED_VALUE_MAPPING_TABLE_BASE_OFFSET 56
+#define EGG_BUS_SENSOR_BLOCK_SAMPLE_AGE_OFFSET        128
+#define EGG_BUS_SENSOR_BLOCK_OVERSAMPLING_OFFSET      132
+#define EGG_BUS_SENSOR_BLOCK_SETTLE_TIMES_OFFSET      136
+#define EGG_BUS_SENSOR_BLOCK_COMPUTED_VALUE_OFFSET    148
+#define EGG_BUS_SENSOR_BLOCK_FILTER_MEDIAN_LENGTH_OFFSET 152
+#define EGG_BUS_SENSOR_BLOCK_FILTER_EWMA_SHIFT_OFFSET 156
+#define EGG_BUS_SENSOR_BLOCK_FILTERED_VALUE_OFFSET    160
+#define EGG_BUS_SENSOR_BLOCK_HISTORY_INTERVAL_OFFSET  164
+#define EGG_BUS_SENSOR_BLOCK_HISTORY_INFO_OFFSET      168
+#define EGG_BUS_SENSOR_BLOCK_HISTORY_ENTRIES_OFFSET   176 // entry n (newest first) is at 176 + 4 * n, up to 8 entries
+#define EGG_BUS_SENSOR_BLOCK_STATS_MIN_OFFSET         208
+#define EGG_BUS_SENSOR_BLOCK_STATS_MAX_OFFSET         212
+#define EGG_BUS_SENSOR_BLOCK_STATS_MEAN_OFFSET        216
+#define EGG_BUS_SENSOR_BLOCK_STATS_VARIANCE_OFFSET    220
+#define EGG_BUS_SENSOR_BLOCK_STATS_COUNT_OFFSET       224
+#define EGG_BUS_SENSOR_BLOCK_STATS_WINDOW_OFFSET      228
+#define EGG_BUS_SENSOR_BLOCK_STATS_SNAPSHOT_OFFSET    232
+#define EGG_BUS_SENSOR_BLOCK_ALARM_THRESHOLD_OFFSET   236
+#define EGG_BUS_SENSOR_BLOCK_ALARM_CONFIG_OFFSET      240
+#define EGG_BUS_SENSOR_BLOCK_ALARM_STATUS_OFFSET      244
+#define EGG_BUS_SENSOR_BLOCK_HEATER_KP_OFFSET         248 // heater PI gains in 1/256 digipot steps per mW
+#define EGG_BUS_SENSOR_BLOCK_HEATER_KI_OFFSET         252
+
+// Snapshot Block Definitions
+#define EGG_BUS_SNAPSHOT_BLOCK_BASE_ADDRESS           65280
+#define EGG_BUS_SNAPSHOT_FRAME                        65280
+
+// Scheduler Block Definitions
+#define EGG_BUS_SCHEDULER_BLOCK_BASE_ADDRESS          65344
+#define EGG_BUS_SCHEDULER_TASK_PERIODS                65344 // task n's period in ms is at 65344 + 4 * n, see SCHEDULER_TASK_*, room for 8
+#define EGG_BUS_SCHEDULER_IDLE_PERMILLE               65376 // share of the last second spent asleep, in parts per thousand
+#define EGG_BUS_SCHEDULER_IDLE_MS                     65380 // milliseconds spent asleep since start up
 
 // Debug Block Definitions
 #define EGG_BUS_DEBUG_BLOCK_BASE_ADDRESS              65408
@@ -50,13 +102,26 @@
 #define EGG_BUS_DEBUG_CO_HEATER_POWER_MW              65432
 #define EGG_BUS_DEBUG_CO_DIGIPOT_WIPER                65436
 #define EGG_BUS_DEBUG_DIGIPOT_STATUS                  65440
+#define EGG_BUS_DEBUG_WAKE_COUNTS                     65444 // wakes out of idle by source n at 65444 + 4 * n, see SCHEDULER_WAKE_*
+
+// always there, whether or not the rest of the debug block is
+#define EGG_BUS_DEBUG_PROFILE_POINTS                  65472 // point n at 65472 + 8 * n, see PROFILE_*: min, max, mean cycles and samples, 16 bits each
+#define EGG_BUS_DEBUG_PROFILE_STRETCH_CYCLES          65512 // cycles SCL has been held low since start up, from TWINT set to TWINT cleared
+#define EGG_BUS_DEBUG_PROFILE_IDLE_PERMILLE           65516 // same as EGG_BUS_SCHEDULER_IDLE_PERMILLE
 
+void egg_bus_init(void);
 uint16_t egg_bus_get_read_address();
 uint8_t egg_bus_map_to_analog_pin(uint8_t sensor_index);
 void egg_bus_set_read_address(uint16_t read_address);
-void egg_bus_get_sensor_type(uint8_t sensor_index, char * target_buffer);
-void egg_bus_get_sensor_units(uint8_t sensor_index, char * target_buffer);
+const char * egg_bus_get_sensor_type_P(uint8_t sensor_index);
+const char * egg_bus_get_sensor_units_P(uint8_t sensor_index);
 uint32_t egg_bus_get_r0_ohms(uint8_t sensor_index);
 void egg_bus_set_r0_ohms(uint8_t sensor_index, uint32_t value);
+uint8_t egg_bus_get_config(void);
+void egg_bus_set_config(uint8_t config);
+uint8_t egg_bus_crc8_update(uint8_t crc, uint8_t data);
+uint8_t egg_bus_crc8(const uint8_t * buffer, uint8_t length);
+uint8_t egg_bus_check_pec(const uint8_t * frame, uint8_t length);
+uint32_t egg_bus_get_pec_error_count(void);
 
 #endif /* EGG_BUS_H_ */
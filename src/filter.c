@@ -0,0 +1,161 @@
+/*
+ * filter.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <stdint.h>
+#include <util/atomic.h>
+#include "filter.h"
+#include "egg_bus.h"
+
+/* each sensor's measurements go through an optional median of the last N values, which throws
+ * away single spikes from heater switching or TWI traffic, and then an exponential moving average
+ *   y += (x - y) / 2^shift
+ * with both stages off (length 1, shift 0) the value comes out untouched */
+typedef struct{
+    uint32_t window[FILTER_MAX_MEDIAN_LENGTH]; // the most recent values, oldest gets overwritten first
+    uint32_t average;                          // EWMA state, in the same units as the input, and the filter output
+    uint8_t  next;                             // where the next value goes in the window
+    uint8_t  count;                            // how many values are in the window
+    uint8_t  primed;                           // zero until average holds a value
+} filter_state_t;
+
+static filter_state_t filter_state[EGG_BUS_NUM_HOSTED_SENSORS];
+static uint8_t filter_median_length[EGG_BUS_NUM_HOSTED_SENSORS] = {1, 1};
+static uint8_t filter_ewma_shift[EGG_BUS_NUM_HOSTED_SENSORS] = {0, 0};
+
+// set from the TWI ISR when the configuration changes, the main loop starts the filter over
+static volatile uint8_t filter_restart[EGG_BUS_NUM_HOSTED_SENSORS];
+
+// odd lengths only so there is always a middle value, even requests get rounded down
+void filter_set_median_length(uint8_t sensor_index, uint8_t length){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    if(length > FILTER_MAX_MEDIAN_LENGTH){
+        length = FILTER_MAX_MEDIAN_LENGTH;
+    }
+    if(length < 1){
+        length = 1;
+    }
+    if((length & 1) == 0){
+        length--;
+    }
+
+    filter_median_length[sensor_index] = length;
+    filter_restart[sensor_index] = 1;
+}
+
+uint8_t filter_get_median_length(uint8_t sensor_index){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return 0;
+    }
+    return filter_median_length[sensor_index];
+}
+
+void filter_set_ewma_shift(uint8_t sensor_index, uint8_t shift){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    if(shift > FILTER_MAX_EWMA_SHIFT){
+        shift = FILTER_MAX_EWMA_SHIFT;
+    }
+
+    filter_ewma_shift[sensor_index] = shift;
+    filter_restart[sensor_index] = 1;
+}
+
+uint8_t filter_get_ewma_shift(uint8_t sensor_index){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return 0;
+    }
+    return filter_ewma_shift[sensor_index];
+}
+
+// middle of the values in the window, by insertion sort on a copy since there are at most a handful of them
+static uint32_t filter_median(filter_state_t * state){
+    uint32_t sorted[FILTER_MAX_MEDIAN_LENGTH];
+    uint32_t value = 0;
+    uint8_t jj = 0;
+
+    for(uint8_t ii = 0; ii < state->count; ii++){
+        value = state->window[ii];
+        for(jj = ii; jj > 0 && sorted[jj - 1] > value; jj--){
+            sorted[jj] = sorted[jj - 1];
+        }
+        sorted[jj] = value;
+    }
+
+    return sorted[(state->count - 1) >> 1];
+}
+
+// feeds a new measurement through the filter and returns the filtered value, main loop only
+uint32_t filter_update(uint8_t sensor_index, uint32_t value){
+    filter_state_t * state = 0;
+    uint32_t average = 0;
+    uint8_t length = 0;
+    uint8_t shift = 0;
+
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return value;
+    }
+
+    state = &(filter_state[sensor_index]);
+    length = filter_median_length[sensor_index];
+    shift = filter_ewma_shift[sensor_index];
+
+    if(filter_restart[sensor_index]){
+        filter_restart[sensor_index] = 0;
+        state->next = 0;
+        state->count = 0;
+        state->primed = 0;
+    }
+
+    // until the window fills up the median is taken over whatever is there
+    state->window[state->next] = value;
+    if(++state->next >= length){
+        state->next = 0;
+    }
+    if(state->count < length){
+        state->count++;
+    }
+    if(length > 1){
+        value = filter_median(state);
+    }
+
+    average = state->average;
+    if(!state->primed){
+        average = value;
+        state->primed = 1;
+    }
+    else if(value >= average){
+        // kept unsigned both ways so the full 32-bit range (including "infinite" resistance) works
+        average += (value - average) >> shift;
+    }
+    else{
+        average -= (average - value) >> shift;
+    }
+
+    // the TWI ISR reads it through filter_get_output
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        state->average = average;
+    }
+
+    return average;
+}
+
+// the value the last filter_update returned, safe to call from the TWI ISR
+uint32_t filter_get_output(uint8_t sensor_index){
+    uint32_t ret = 0;
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return 0;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        ret = filter_state[sensor_index].average;
+    }
+    return ret;
+}
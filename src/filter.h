@@ -0,0 +1,26 @@
+/*
+ * filter.h
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include <stdint.h>
+
+// longest median window, each extra point costs 4 bytes of RAM per sensor so 3 (enough to drop a single spike) is the default
+#ifndef FILTER_MAX_MEDIAN_LENGTH
+#define FILTER_MAX_MEDIAN_LENGTH    3
+#endif
+// the EWMA weight of a new value is 1 / 2^shift, so 0 turns the average off
+#define FILTER_MAX_EWMA_SHIFT       8
+
+void filter_set_median_length(uint8_t sensor_index, uint8_t length);
+uint8_t filter_get_median_length(uint8_t sensor_index);
+void filter_set_ewma_shift(uint8_t sensor_index, uint8_t shift);
+uint8_t filter_get_ewma_shift(uint8_t sensor_index);
+uint32_t filter_update(uint8_t sensor_index, uint32_t value);
+uint32_t filter_get_output(uint8_t sensor_index);
+
+#endif /* FILTER_H_ */
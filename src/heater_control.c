@@ -6,61 +6,143 @@
  */
 
 #include <stdint.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
 #include "heater_control.h"
 #include "main.h"
 #include "egg_bus.h"
 #include "adc.h"
 #include "digipot.h"
 #include "utility.h"
+#include "profile.h"
 
 /* this table stores the mapping of sensors to support hardware and associated configuration data */
-static const sensor_config_t sensor_config[EGG_BUS_NUM_HOSTED_SENSORS] = {
+static const sensor_config_t sensor_config[EGG_BUS_NUM_HOSTED_SENSORS] PROGMEM = {
         {NO2_HEATER_FEEDBACK_RESISTANCE, NO2_HEATER_TARGET_POWER_MW, NO2_HEATER_POWER_ADC, NO2_HEATER_FEEDBACK_ADC, DIGIPOT_WIPER1},
         {CO_HEATER_FEEDBACK_RESISTANCE, CO_HEATER_TARGET_POWER_MW, CO_HEATER_POWER_ADC, CO_HEATER_FEEDBACK_ADC, DIGIPOT_WIPER0}
 };
 
-// returns -1 if the calculated power required a decrement
-// returns  0 if no adjustment was needed
-// returns +1 if the calculated power required an increment
-int32_t heater_control_manage(uint8_t sensor_index, uint8_t momentum){
+static uint16_t heater_control_kp[EGG_BUS_NUM_HOSTED_SENSORS] = { HEATER_CONTROL_DEFAULT_KP, HEATER_CONTROL_DEFAULT_KP };
+static uint16_t heater_control_ki[EGG_BUS_NUM_HOSTED_SENSORS] = { HEATER_CONTROL_DEFAULT_KI, HEATER_CONTROL_DEFAULT_KI };
+static int16_t heater_control_last_error[EGG_BUS_NUM_HOSTED_SENSORS];
+static int16_t heater_control_remainder[EGG_BUS_NUM_HOSTED_SENSORS]; // fraction of a step carried over, in 1/256 steps
 
-    sensor_config_t * scfg = (sensor_config_t *) &(sensor_config[sensor_index]);
-    uint32_t target_power_mw = scfg->heater_target_power_mw;
-    uint8_t  digipot_wiper_num = scfg->digipot_wiper;
+// the heater channel readings every update works from, kept for the TWI ISR
+static uint16_t heater_control_power_voltage[EGG_BUS_NUM_HOSTED_SENSORS];
+static uint16_t heater_control_feedback_voltage[EGG_BUS_NUM_HOSTED_SENSORS];
 
-    uint32_t heater_power_mw = heater_control_get_heater_power_mw(sensor_index);
+// both heater channels averaged over the last few passes of the ADC task, main loop only
+void heater_control_measure(uint8_t sensor_index){
+    uint16_t power_voltage = adc_get_average(heater_control_get_power_adc_channel(sensor_index));
+    uint16_t feedback_voltage = adc_get_average(heater_control_get_feedback_adc_channel(sensor_index));
 
+    // the TWI ISR reads these, so both change together
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        heater_control_power_voltage[sensor_index] = power_voltage;
+        heater_control_feedback_voltage[sensor_index] = feedback_voltage;
+    }
+}
+
+// returns the error in mW that the wiper was adjusted for, positive if the heater was under its target power
+int32_t heater_control_manage(uint8_t sensor_index){
+    uint16_t profile_start_count = profile_start();
+    uint32_t target_power_mw = heater_control_get_target_power_mw(sensor_index);
+    uint8_t  digipot_wiper_num = pgm_read_byte(&sensor_config[sensor_index].digipot_wiper);
+    uint32_t heater_power_mw = 0;
+    int32_t error = 0;
+    int32_t change = 0;
+    int32_t steps = 0;
+    int16_t wiper = digipot_get_wiper(digipot_wiper_num);
+
+    heater_control_measure(sensor_index);
+    heater_power_mw = heater_control_get_heater_power_mw(sensor_index);
+    error = (int32_t) target_power_mw - (int32_t) heater_power_mw;
+
+    // keeps the sums comfortably inside 32 bits whatever the ADC says
+    if(error > 1000){
+        error = 1000;
+    }
+    else if(error < -1000){
+        error = -1000;
+    }
+
+    change = (int32_t) heater_control_kp[sensor_index] * (error - heater_control_last_error[sensor_index])
+            + (int32_t) heater_control_ki[sensor_index] * error
+            + heater_control_remainder[sensor_index];
+    heater_control_last_error[sensor_index] = error;
 
+    // whole steps now, the rest next time (the shift rounds towards minus infinity so the remainder is never negative)
+    steps = change >> HEATER_CONTROL_GAIN_SHIFT;
+    heater_control_remainder[sensor_index] = change - steps * (1L << HEATER_CONTROL_GAIN_SHIFT);
 
-    // adjust the voltage being output by the adjustable regulator by
-    // changing increasing or decreasing the variable feedback resistance
-    if(heater_power_mw > target_power_mw){
-        // cool down a bit
-        digipot_increment(digipot_wiper_num, momentum);
+    // anything that can't be applied is dropped rather than saved up, that's the anti-windup
+    if(steps > HEATER_CONTROL_MAX_STEPS){
+        steps = HEATER_CONTROL_MAX_STEPS;
+        heater_control_remainder[sensor_index] = 0;
     }
-    else if(heater_power_mw < target_power_mw){
-        // heat up a bit
-        digipot_decrement(digipot_wiper_num, momentum);
+    else if(steps < -HEATER_CONTROL_MAX_STEPS){
+        steps = -HEATER_CONTROL_MAX_STEPS;
+        heater_control_remainder[sensor_index] = 0;
     }
 
-    return ((int32_t) target_power_mw - (int32_t) heater_power_mw);
+    // a higher wiper setting means a lower regulator voltage, so more power needs the wiper to come down
+    if(wiper - steps < 0){
+        steps = wiper;
+        heater_control_remainder[sensor_index] = 0;
+    }
+    else if(wiper - steps > DIGIPOT_WIPER_MAX){
+        steps = wiper - DIGIPOT_WIPER_MAX;
+        heater_control_remainder[sensor_index] = 0;
+    }
+
+    if(steps != 0){
+        digipot_write_wiper(digipot_wiper_num, wiper - steps);
+    }
+
+    profile_stop(PROFILE_HEATER_CONTROL, profile_start_count);
+    return error;
+}
+
+// the gains are in 1/256 wiper steps, main loop only
+void heater_control_set_kp(uint8_t sensor_index, uint16_t kp){
+    heater_control_kp[sensor_index] = kp;
+}
+
+uint16_t heater_control_get_kp(uint8_t sensor_index){
+    return heater_control_kp[sensor_index];
+}
+
+void heater_control_set_ki(uint8_t sensor_index, uint16_t ki){
+    heater_control_ki[sensor_index] = ki;
+}
+
+uint16_t heater_control_get_ki(uint8_t sensor_index){
+    return heater_control_ki[sensor_index];
 }
 
+uint8_t heater_control_get_power_adc_channel(uint8_t sensor_index){
+    return pgm_read_byte(&sensor_config[sensor_index].heater_power_adc);
+}
+
+uint8_t heater_control_get_feedback_adc_channel(uint8_t sensor_index){
+    return pgm_read_byte(&sensor_config[sensor_index].heater_feedback_adc);
+}
+
+// the readings from the last update or snapshot rather than fresh conversions, so these are safe to use from the TWI ISR
 uint16_t heater_control_get_heater_power_voltage(uint8_t sensor_index){
-    sensor_config_t * scfg = (sensor_config_t *) &(sensor_config[sensor_index]);
-    uint8_t power_adc_num = scfg->heater_power_adc;
-    return analogRead(power_adc_num);
+    return heater_control_power_voltage[sensor_index];
 }
 
 uint16_t heater_control_get_heater_feedback_voltage(uint8_t sensor_index){
-    sensor_config_t * scfg = (sensor_config_t *) &(sensor_config[sensor_index]);
-    uint8_t feedback_adc_num = scfg->heater_feedback_adc;
-    return analogRead(feedback_adc_num);
+    return heater_control_feedback_voltage[sensor_index];
+}
+
+uint32_t heater_control_get_target_power_mw(uint8_t sensor_index){
+    return pgm_read_dword(&sensor_config[sensor_index].heater_target_power_mw);
 }
 
 uint32_t heater_control_get_heater_power_mw(uint8_t sensor_index){
-    sensor_config_t * scfg = (sensor_config_t *) &(sensor_config[sensor_index]);
-    uint32_t feedback_resistance = scfg->heater_feedback_resistance;
+    uint32_t feedback_resistance = pgm_read_dword(&sensor_config[sensor_index].heater_feedback_resistance);
 
     uint16_t heater_power_voltage = heater_control_get_heater_power_voltage(sensor_index);
     uint16_t heater_feedback_voltage = heater_control_get_heater_feedback_voltage(sensor_index);
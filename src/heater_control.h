@@ -10,6 +10,19 @@
 
 #include <stdint.h>
 
+/* PI control of the heater power, in velocity form: every update moves the wiper by
+ *   (kp * (error - last error) + ki * error) / 256 steps
+ * with the error in mW, so the wiper position itself is the integral term and stops
+ * winding up as soon as it hits an end of its travel */
+#define HEATER_CONTROL_GAIN_SHIFT   8
+#ifndef HEATER_CONTROL_DEFAULT_KP
+#define HEATER_CONTROL_DEFAULT_KP   16  // 1/16 step per mW change in the error
+#endif
+#ifndef HEATER_CONTROL_DEFAULT_KI
+#define HEATER_CONTROL_DEFAULT_KI   128 // 1/2 step per mW of error
+#endif
+#define HEATER_CONTROL_MAX_STEPS    64  // most the wiper moves in one update
+
 typedef struct{
     uint32_t heater_feedback_resistance;
     uint32_t heater_target_power_mw;
@@ -18,10 +31,17 @@ typedef struct{
     uint8_t  digipot_wiper;
 } sensor_config_t;
 
-int32_t heater_control_manage(uint8_t sensor_index, uint8_t momentum);
+void heater_control_measure(uint8_t sensor_index);
+int32_t heater_control_manage(uint8_t sensor_index);
+void heater_control_set_kp(uint8_t sensor_index, uint16_t kp);
+uint16_t heater_control_get_kp(uint8_t sensor_index);
+void heater_control_set_ki(uint8_t sensor_index, uint16_t ki);
+uint16_t heater_control_get_ki(uint8_t sensor_index);
+uint8_t heater_control_get_power_adc_channel(uint8_t sensor_index);
+uint8_t heater_control_get_feedback_adc_channel(uint8_t sensor_index);
 uint16_t heater_control_get_heater_power_voltage(uint8_t sensor_index);
 uint16_t heater_control_get_heater_feedback_voltage(uint8_t sensor_index);
 uint32_t heater_control_get_heater_power_mw(uint8_t sensor_index);
-uint32_t heater_control_get_heater_power_mw(uint8_t sensor_index);
+uint32_t heater_control_get_target_power_mw(uint8_t sensor_index);
 
 #endif /* HEATER_CONTROL_H_ */
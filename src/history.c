@@ -0,0 +1,136 @@
+/*
+ * history.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <stdint.h>
+#include <util/atomic.h>
+#include "history.h"
+#include "egg_bus.h"
+#include "timer.h"
+#include "utility.h"
+
+/* the last HISTORY_DEPTH computed values for each sensor, one every interval, so a master that
+ * only polls every few minutes can still pick up everything in between with a couple of reads */
+typedef struct{
+    uint16_t value;  // computed value, saturated to 16 bits
+    uint16_t tick;   // history_get_tick() when it was recorded
+} history_entry_t;
+
+typedef struct{
+    history_entry_t entries[HISTORY_DEPTH];
+    uint32_t sequence;        // number of entries ever recorded, the newest entry has this number
+    uint16_t interval_ticks;  // how far apart entries are recorded, 0 records every sample
+    uint8_t  next;            // the slot the next entry goes into
+} history_t;
+
+static history_t history[EGG_BUS_NUM_HOSTED_SENSORS] = {
+        { .interval_ticks = HISTORY_DEFAULT_INTERVAL_TICKS },
+        { .interval_ticks = HISTORY_DEFAULT_INTERVAL_TICKS }
+};
+
+uint16_t history_get_tick(void){
+    return (uint16_t) (timer_millis() >> HISTORY_TICK_SHIFT);
+}
+
+// called by the sampler with every new sample, only keeps one per interval
+void history_record(uint8_t sensor_index, uint32_t value){
+    history_t * h = 0;
+    uint16_t tick = history_get_tick();
+    uint8_t newest = 0;
+
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    h = &(history[sensor_index]);
+    // the newest entry is the one just before next
+    newest = h->next == 0 ? HISTORY_DEPTH - 1 : h->next - 1;
+    if(h->sequence != 0 && (uint16_t) (tick - h->entries[newest].tick) < h->interval_ticks){
+        return;
+    }
+
+    // the TWI ISR reads these, so the entry and the sequence number have to change together
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        h->entries[h->next].value = value > 0xffff ? 0xffff : (uint16_t) value;
+        h->entries[h->next].tick = tick;
+        if(++h->next >= HISTORY_DEPTH){
+            h->next = 0;
+        }
+        h->sequence++;
+    }
+}
+
+void history_set_interval(uint8_t sensor_index, uint16_t interval_ticks){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        history[sensor_index].interval_ticks = interval_ticks;
+    }
+}
+
+uint16_t history_get_interval(uint8_t sensor_index){
+    uint16_t ret = 0;
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return 0;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        ret = history[sensor_index].interval_ticks;
+    }
+    return ret;
+}
+
+static uint8_t history_get_count(history_t * h){
+    return h->sequence < HISTORY_DEPTH ? (uint8_t) h->sequence : HISTORY_DEPTH;
+}
+
+/* fills HISTORY_INFO_LENGTH bytes, the master can compare the sequence number before and
+ * after reading the entries to tell whether a new one was recorded in the meantime */
+void history_get_info(uint8_t sensor_index, uint8_t * buffer){
+    history_t * h = 0;
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    h = &(history[sensor_index]);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        big_endian_copy_uint32_to_buffer(h->sequence, buffer);
+        buffer[6] = history_get_count(h);
+    }
+    big_endian_copy_uint16_to_buffer(history_get_tick(), buffer + 4);
+    buffer[7] = HISTORY_DEPTH;
+}
+
+/* copies as many entries as fit in the buffer, newest first, starting first_entry entries back
+ * returns the number of bytes written, which is zero past the oldest entry */
+uint8_t history_copy_entries(uint8_t sensor_index, uint8_t first_entry, uint8_t * buffer, uint8_t buffer_length){
+    history_t * h = 0;
+    uint8_t length = 0;
+    uint8_t count = 0;
+    uint8_t slot = 0;
+
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return 0;
+    }
+
+    h = &(history[sensor_index]);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        count = history_get_count(h);
+        for(uint8_t ii = first_entry; ii < count && length + HISTORY_ENTRY_LENGTH <= buffer_length; ii++){
+            // the newest entry is the one just before next
+            slot = h->next + HISTORY_DEPTH - 1 - ii;
+            if(slot >= HISTORY_DEPTH){
+                slot -= HISTORY_DEPTH;
+            }
+            big_endian_copy_uint16_to_buffer(h->entries[slot].value, buffer + length);
+            big_endian_copy_uint16_to_buffer(h->entries[slot].tick, buffer + length + 2);
+            length += HISTORY_ENTRY_LENGTH;
+        }
+    }
+
+    return length;
+}
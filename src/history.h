@@ -0,0 +1,42 @@
+/*
+ * history.h
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <stdint.h>
+
+/* the buffer is meant for a master that polls every 5 minutes or so, and holds twice that so one late
+ * poll doesn't lose anything: HISTORY_DEPTH entries HISTORY_DEFAULT_INTERVAL_TICKS apart cover
+ * 4 * 150 * 1.024s, a little over 10 minutes. RAM is what's short, so a longer poll period
+ * is better served by a longer interval than by more entries */
+
+// entries kept per sensor, 4 bytes of RAM each
+#ifndef HISTORY_DEPTH
+#define HISTORY_DEPTH               4
+#endif
+#define HISTORY_MAX_DEPTH           8   // what the register map has room for
+#if HISTORY_DEPTH > HISTORY_MAX_DEPTH
+#error "HISTORY_DEPTH does not fit in the sensor block"
+#endif
+
+// history timestamps count in units of 2^10 ms (a little over a second) and wrap after about 18 hours
+#define HISTORY_TICK_SHIFT          10
+#ifndef HISTORY_DEFAULT_INTERVAL_TICKS
+#define HISTORY_DEFAULT_INTERVAL_TICKS 150
+#endif
+
+#define HISTORY_ENTRY_LENGTH        4   // value (2 bytes) then tick (2 bytes), both big endian
+#define HISTORY_INFO_LENGTH         8   // sequence (4 bytes), current tick (2 bytes), entry count, depth
+
+uint16_t history_get_tick(void);
+void history_record(uint8_t sensor_index, uint32_t value);
+void history_set_interval(uint8_t sensor_index, uint16_t interval_ticks);
+uint16_t history_get_interval(uint8_t sensor_index);
+void history_get_info(uint8_t sensor_index, uint8_t * buffer);
+uint8_t history_copy_entries(uint8_t sensor_index, uint8_t first_entry, uint8_t * buffer, uint8_t buffer_length);
+
+#endif /* HISTORY_H_ */
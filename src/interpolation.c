@@ -7,6 +7,8 @@
 
 #include "interpolation.h"
 #include "egg_bus.h"
+#include "interpolation_lut.h"
+#include <avr/pgmspace.h>
 #include <float.h>
 
 #define INTERPOLATION_X_INDEX 0
@@ -14,60 +16,140 @@
 #define INTERPOLATION_TERMINATOR 0xff
 
 // these are the conversion factors required to turn into floating point values (multiply table values by these)
-const float x_scaler[EGG_BUS_NUM_HOSTED_SENSORS] = {0.4f, 0.003f};
-const float y_scaler[EGG_BUS_NUM_HOSTED_SENSORS] = {1.7f, 165.0f};
-const float independent_scaler[EGG_BUS_NUM_HOSTED_SENSORS] = {0.0001f, 0.0004f};
-const uint32_t independent_scaler_inverse[EGG_BUS_NUM_HOSTED_SENSORS] = { 10000, 2500 };
+// all of the constants here live in flash, none of them are worth the RAM
+static const float x_scaler[EGG_BUS_NUM_HOSTED_SENSORS] PROGMEM = {0.4f, 0.003f};
+static const float y_scaler[EGG_BUS_NUM_HOSTED_SENSORS] PROGMEM = {1.7f, 165.0f};
+static const float independent_scaler[EGG_BUS_NUM_HOSTED_SENSORS] PROGMEM = {0.0001f, 0.0004f};
+static const uint32_t independent_scaler_inverse[EGG_BUS_NUM_HOSTED_SENSORS] PROGMEM = { 10000, 2500 };
+
+// the values MUST be provided in ascending order of x-value
+static const uint8_t no2_ppb[][2] PROGMEM = {
+        {62,117},
+        {75,131},
+        {101,152},
+        {149,188},
+        {174,204},
+        {199,219},
+        {223,233},
+        {247,246},
+        {INTERPOLATION_TERMINATOR, INTERPOLATION_TERMINATOR}
+};
+
+static const uint8_t co_ppb[][2] PROGMEM = {
+        {134,250},
+        {168,125},
+        {202,49},
+        {232,12},
+        {241,6},
+        {INTERPOLATION_TERMINATOR, INTERPOLATION_TERMINATOR}
+};
 
 // get_x_or_get_y = 0 returns x value from table, get_x_or_get_y = 1 returns y value from table
 uint8_t getTableValue(uint8_t sensor_index, uint8_t table_index, uint8_t get_x_or_get_y){
+    // sensor index 0 is the NO2 sensor
+    const uint8_t (*table)[2] = sensor_index == 0 ? no2_ppb : co_ppb; // sensor index 1 is for CO
 
-    // the values MUST be provided in ascending order of x-value
-    const uint8_t no2_ppb[][2] = {
-            {62,117},
-            {75,131},
-            {101,152},
-            {149,188},
-            {174,204},
-            {199,219},
-            {223,233},
-            {247,246},
-            {INTERPOLATION_TERMINATOR, INTERPOLATION_TERMINATOR}
-    };
-
-    const uint8_t co_ppb[][2] = {
-            {134,250},
-            {168,125},
-            {202,49},
-            {232,12},
-            {241,6},
-            {INTERPOLATION_TERMINATOR, INTERPOLATION_TERMINATOR}
-    };
+    // anything past the end of the table reads as the terminator
+    for(uint8_t ii = 0; ii < table_index; ii++){
+        if(pgm_read_byte(&table[ii][INTERPOLATION_X_INDEX]) == INTERPOLATION_TERMINATOR){
+            return INTERPOLATION_TERMINATOR;
+        }
+    }
 
-    // sensor index 0 is the NO2 sensor
-    uint8_t return_value = 0;
-    if(sensor_index == 0){
-        return_value = no2_ppb[table_index][get_x_or_get_y];
+    return pgm_read_byte(&table[table_index][get_x_or_get_y]);
+}
+
+// log2 of a non-zero value with INTERPOLATION_LOG2_Q fractional bits, the integer part is the
+// position of the top bit and the fraction comes from interpolating between the mantissa table entries
+static uint32_t interpolation_log2(uint32_t value){
+    uint8_t msb = 31;
+    uint16_t fraction = 0;
+    uint8_t index = 0;
+    uint16_t remainder = 0;
+    uint16_t low = 0;
+    uint16_t high = 0;
+
+    while(!(value & 0x80000000UL)){
+        value <<= 1;
+        msb--;
     }
-    else{  // sensor index 1 is for CO
-        return_value = co_ppb[table_index][get_x_or_get_y];
+
+    fraction = (value >> (31 - INTERPOLATION_LOG2_Q)) & ((1 << INTERPOLATION_LOG2_Q) - 1);
+    index = fraction >> (INTERPOLATION_LOG2_Q - INTERPOLATION_LOG2_FRACTION_BITS);
+    remainder = fraction & ((1 << (INTERPOLATION_LOG2_Q - INTERPOLATION_LOG2_FRACTION_BITS)) - 1);
+    low = pgm_read_word(&interpolation_log2_fraction[index]);
+    high = pgm_read_word(&interpolation_log2_fraction[index + 1]);
+
+    return (((uint32_t) msb) << INTERPOLATION_LOG2_Q) + low
+            + ((((uint32_t) (high - low)) * remainder) >> (INTERPOLATION_LOG2_Q - INTERPOLATION_LOG2_FRACTION_BITS));
+}
+
+/* turns the independent variable (R / R0 scaled by the independent scaler inverse) into ppb
+ * with the log-domain lookup table generated from the sensor's table (see tools/gen_interpolation_lut.py),
+ * one table read and one multiply-add between neighbouring entries. Values outside the table are clamped to its ends.
+ * The table follows the straight lines between the table points that the master draws from the table and scaler
+ * registers, to within 4% (the worst of it where the lines bend, tests/test_interpolation checks it) */
+uint32_t interpolation_compute_ppb(uint8_t sensor_index, uint32_t independent_value){
+    const uint16_t * lut = no2_ppb_lut;
+    int32_t base = INTERPOLATION_LUT_NO2_LOG2_BASE;
+    uint8_t step_shift = INTERPOLATION_LUT_NO2_STEP_SHIFT;
+    uint8_t length = INTERPOLATION_LUT_NO2_LENGTH;
+    int32_t position = 0;
+    int32_t last = 0;
+    uint8_t index = 0;
+    uint16_t step = 0;
+    int32_t y0 = 0;
+    int32_t y1 = 0;
+
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return 0;
+    }
+
+    if(sensor_index == 1){
+        lut = co_ppb_lut;
+        base = INTERPOLATION_LUT_CO_LOG2_BASE;
+        step_shift = INTERPOLATION_LUT_CO_STEP_SHIFT;
+        length = INTERPOLATION_LUT_CO_LENGTH;
     }
 
-    return return_value;
+    last = ((int32_t) (length - 1)) << step_shift;
+    if(independent_value != 0){
+        position = (int32_t) interpolation_log2(independent_value) - base;
+    }
+
+    if(position < 0){
+        position = 0;
+    }
+    else if(position > last){
+        position = last;
+    }
+
+    index = position >> step_shift;
+    y0 = pgm_read_word(&lut[index]);
+    if(position == last){
+        return y0;
+    }
+
+    step = position & ((1 << step_shift) - 1);
+    y1 = pgm_read_word(&lut[index + 1]);
+
+    // |y1 - y0| < 2^16 and step < 2^8 so the product fits comfortably
+    return y0 + ((y1 - y0) * (int32_t) step) / (1L << step_shift);
 }
 
-uint8_t * get_p_x_scaler(uint8_t sensor_index){
-    return (uint8_t *) &(x_scaler[sensor_index]);
+// the scaler pointers are flash addresses, for pgm_read_byte and friends
+const uint8_t * get_p_x_scaler(uint8_t sensor_index){
+    return (const uint8_t *) &(x_scaler[sensor_index]);
 }
 
-uint8_t * get_p_y_scaler(uint8_t sensor_index){
-    return (uint8_t *) &(y_scaler[sensor_index]);
+const uint8_t * get_p_y_scaler(uint8_t sensor_index){
+    return (const uint8_t *) &(y_scaler[sensor_index]);
 }
 
-uint8_t * get_p_independent_scaler(uint8_t sensor_index){
-    return (uint8_t *) &(independent_scaler[sensor_index]);
+const uint8_t * get_p_independent_scaler(uint8_t sensor_index){
+    return (const uint8_t *) &(independent_scaler[sensor_index]);
 }
 
 uint32_t get_independent_scaler_inverse(uint8_t sensor_index){
-    return independent_scaler_inverse[sensor_index];
+    return pgm_read_dword(&independent_scaler_inverse[sensor_index]);
 }
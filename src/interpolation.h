@@ -11,9 +11,10 @@
 #include <stdint.h>
 
 uint8_t getTableValue(uint8_t sensor_index, uint8_t table_index, uint8_t get_x_or_get_y);
-uint8_t * get_p_x_scaler(uint8_t sensor_index);
-uint8_t * get_p_y_scaler(uint8_t sensor_index);
-uint8_t * get_p_independent_scaler(uint8_t sensor_index);
+const uint8_t * get_p_x_scaler(uint8_t sensor_index);
+const uint8_t * get_p_y_scaler(uint8_t sensor_index);
+const uint8_t * get_p_independent_scaler(uint8_t sensor_index);
 uint32_t get_independent_scaler_inverse(uint8_t sensor_index);
+uint32_t interpolation_compute_ppb(uint8_t sensor_index, uint32_t independent_value);
 
 #endif /* INTERPOLATION_H_ */
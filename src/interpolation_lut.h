@@ -0,0 +1,55 @@
+/*
+ * interpolation_lut.h
+ *
+ *  Generated by tools/gen_interpolation_lut.py from the tables in interpolation.c
+ *  do not edit by hand, re-run the script instead
+ */
+
+#ifndef INTERPOLATION_LUT_H_
+#define INTERPOLATION_LUT_H_
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#define INTERPOLATION_LOG2_Q 12 // log2 values carry 12 fractional bits
+#define INTERPOLATION_LOG2_FRACTION_BITS 4
+
+// log2(1 + i / 16) scaled by 2^12
+static const uint16_t interpolation_log2_fraction[17] PROGMEM = {
+        0, 358, 696, 1016, 1319, 1607, 1882, 2145, 2396, 2637, 2869, 3092, 3307, 3514, 3715, 3908, 4096
+};
+
+// ppb, starting at log2(independent value) = 73400 / 2^12 and stepping 1/16 of an octave
+#define INTERPOLATION_LUT_NO2_LOG2_BASE 73400L
+#define INTERPOLATION_LUT_NO2_STEP_SHIFT 8
+#define INTERPOLATION_LUT_NO2_LENGTH 33
+static const uint16_t no2_ppb_lut[INTERPOLATION_LUT_NO2_LENGTH] PROGMEM = {
+        199, 204, 209, 215, 220, 225, 230, 235,
+        240, 245, 251, 257, 263, 268, 275, 281,
+        288, 295, 302, 310, 318, 325, 332, 340,
+        348, 356, 364, 373, 382, 391, 400, 409,
+        418
+};
+
+// ppb, starting at log2(independent value) = 40849 / 2^12 and stepping 1/128 of an octave
+#define INTERPOLATION_LUT_CO_LOG2_BASE 40849L
+#define INTERPOLATION_LUT_CO_STEP_SHIFT 5
+#define INTERPOLATION_LUT_CO_LENGTH 110
+static const uint16_t co_ppb_lut[INTERPOLATION_LUT_CO_LENGTH] PROGMEM = {
+        41250, 40813, 40369, 39923, 39475, 39024, 38570, 38114,
+        37656, 37195, 36732, 36266, 35797, 35326, 34853, 34376,
+        33898, 33416, 32933, 32446, 31957, 31465, 30971, 30473,
+        29973, 29471, 28965, 28457, 27947, 27433, 26917, 26397,
+        25875, 25350, 24823, 24292, 23759, 23222, 22683, 22141,
+        21596, 21048, 20547, 20210, 19871, 19531, 19188, 18844,
+        18498, 18150, 17800, 17448, 17095, 16739, 16381, 16022,
+        15661, 15297, 14932, 14564, 14195, 13824, 13450, 13075,
+        12697, 12318, 11936, 11553, 11167, 10779, 10389, 9997,
+        9603, 9207, 8808, 8408, 8041, 7817, 7593, 7367,
+        7140, 6911, 6682, 6451, 6219, 5986, 5751, 5515,
+        5278, 5040, 4800, 4559, 4316, 4073, 3828, 3581,
+        3334, 3085, 2834, 2583, 2330, 2075, 1893, 1754,
+        1614, 1474, 1332, 1190, 1047, 990
+};
+
+#endif /* INTERPOLATION_LUT_H_ */
@@ -6,6 +6,7 @@
  */
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <stdint.h>
 #include <string.h>
 #include "utility.h"
@@ -14,291 +15,226 @@
 #include "spi.h"
 #include "adc.h"
 #include "egg_bus.h"
+#include "registers.h"
 #include "digipot.h"
 #include "heater_control.h"
 #include "mac.h"
 #include "interpolation.h"
+#include "sampler.h"
+#include "filter.h"
+#include "history.h"
+#include "stats.h"
+#include "alarm.h"
+#include "timer.h"
+#include "scheduler.h"
+#include "profile.h"
 #include <math.h>
 #include <limits.h>
 #define __DELAY_BACKWARD_COMPATIBLE__
 #include <util/delay.h>
 
-//#define INCLUDE_DEBUG_REGISTERS
-
 void onRequestService(void);
+void onRequestRefillService(void);
 void onReceiveService(uint8_t* inBytes, int numBytes);
 
 void setup(void);
+void setup_adc(void);
 
 uint8_t macaddr[6];
 
+// where a read that carries on past the first field picks up next
+static uint16_t stream_address = 0;
+
+// where the bytes of the response going out come from, the TWI ISR fetches them one at a time.
+// live values are built in the response buffer so they can't change while they go out,
+// anything that doesn't change goes out straight from where it is
+static uint8_t response[EGG_BUS_MAX_RESPONSE_LENGTH];
+static twi_source_t response_source;
+
+// writes come in through the TWI receive buffer, the longest one has to fit with its CRC
+#if TWI_BUFFER_LENGTH < EGG_BUS_WRITE_FRAME_LENGTH + 1
+#error "TWI_BUFFER_LENGTH is too short for an Egg Bus write frame and its PEC byte"
+#endif
+
+// the response to the first read after a READ command is set up as soon as the address arrives,
+// so a repeated start SLA+R straight after the write can be served without building it first
+static uint8_t response_prepared = 0;
+
+// with PEC on, the CRC of the response goes out as the first refill
+static uint8_t pec_pending = 0;
+static uint8_t pec_crc = 0;
+
+static void main_heater_task(void);
+static void main_sampler_task(void);
+static void main_led_task(void);
+
+// indexed by SCHEDULER_TASK_*
+static const scheduler_task_t main_tasks[SCHEDULER_NUM_TASKS] PROGMEM = {
+        main_heater_task,
+        main_sampler_task,
+        registers_run_deferred, // writes that were too slow to do in the TWI ISR, R0 to EEPROM among them
+        main_led_task,
+        adc_run_sequence        // keeps the ADC rings the heater control reads from fresh
+};
+
 void main(void) __attribute__((noreturn));
 void main(void) {
-    uint8_t momentum[2] = {1, 1};
-    int8_t last_direction[2] = {0,0};
-
     setup();
     sei();    // enable interrupts
 
-    // This loop runs forever, its sole purpose is to keep the heater power constant
-    // it can be interrupted at any point by a TWI event
-    for (;;) {
-        for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
-            int8_t direction = heater_control_manage(ii, momentum[ii]) > 0 ? 1 : -1;
-
-            if(direction == last_direction[ii] && direction != 0){
-                momentum[ii] += 1; // change faster
-            }
-            else{
-                momentum[ii] = 1; // reset to slow changes
-            }
-
-            if(direction != 0){
-                last_direction[ii] = direction;
-            }
-        }
+    // From here on the scheduler runs the tasks forever, it keeps the heater power constant and keeps
+    // the cached sensor samples fresh so that the TWI ISR never has to wait on the ADC,
+    // and sleeps in between. any task can be interrupted at any point by a TWI event
+    scheduler_init(main_tasks);
+    scheduler_run();
+}
+
+// only changes the heater voltage every few seconds to give it time to settle in
+static void main_heater_task(void){
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        heater_control_manage(ii);
+    }
+    // for the debug register, the SPI traffic belongs here rather than in the TWI ISR
+    digipot_refresh_status();
+}
 
-        delay_sec(3); // only change the heater voltage every three seconds or so to give it time to settle in
+// filtering, history, statistics and alarms all happen as part of each new sample
+static void main_sampler_task(void){
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        sampler_update(ii);
     }
+    sampler_capture_snapshot();
+}
+
+// slow blink on the status LED to show the scheduler is alive
+static void main_led_task(void){
+    STATUS_LED_TOGGLE();
 }
 
 // this gets called when you get an SLA+R
 void onRequestService(void){
-    uint8_t response[EGG_BUS_MAX_RESPONSE_LENGTH] = { 0 };
-    uint8_t response_length = 4; // unless it gets overridden 4 is the default
-    uint8_t sensor_index = 0;
-    uint8_t sensor_field_offset = 0;
     uint16_t address = egg_bus_get_read_address(); // get the address requested in the SLA+W
-    uint16_t sensor_block_relative_address = address - ((uint16_t) EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS);
-    uint16_t possible_values[3] = {0,0,0};
-    uint32_t possible_low_side_resistances[3] = {0,0,0};
-    uint8_t best_value_index = 0;
-    uint32_t responseValue = 0;
-    uint32_t temp = 0;
-    switch(address){
-    case EGG_BUS_ADDRESS_SENSOR_COUNT:
-        response[0] = EGG_BUS_NUM_HOSTED_SENSORS;
-        response_length = 1;
-        break;
-    case EGG_BUS_ADDRESS_MODULE_ID:
-        memcpy(response, macaddr, 6);
-        response_length = 6;
-        break;
-    case EGG_BUS_FIRMWARE_VERSION:
-        big_endian_copy_uint32_to_buffer(EGG_BUS_FIRMWARE_VERSION_NUMBER, response);
-        break;
-#ifdef INCLUDE_DEBUG_REGISTERS
-    case EGG_BUS_DEBUG_NO2_HEATER_VOLTAGE_PLUS:
-        big_endian_copy_uint32_to_buffer(heater_control_get_heater_power_voltage(0), response);
-        break;
-    case EGG_BUS_DEBUG_NO2_HEATER_VOLTAGE_MINUS:
-        big_endian_copy_uint32_to_buffer(heater_control_get_heater_feedback_voltage(0), response);
-        break;
-    case EGG_BUS_DEBUG_NO2_HEATER_POWER_MW:
-        big_endian_copy_uint32_to_buffer(heater_control_get_heater_power_mw(0), response);
-        break;
-    case EGG_BUS_DEBUG_NO2_DIGIPOT_WIPER:
-        big_endian_copy_uint32_to_buffer((uint32_t) digipot_read_wiper1(), response);
-        break;
-    case EGG_BUS_DEBUG_CO_HEATER_VOLTAGE_PLUS:
-        big_endian_copy_uint32_to_buffer(heater_control_get_heater_power_voltage(1), response);
-        break;
-    case EGG_BUS_DEBUG_CO_HEATER_VOLTAGE_MINUS:
-        big_endian_copy_uint32_to_buffer(heater_control_get_heater_feedback_voltage(1), response);
-        break;
-    case EGG_BUS_DEBUG_CO_HEATER_POWER_MW:
-        big_endian_copy_uint32_to_buffer(heater_control_get_heater_power_mw(1), response);
-        break;
-    case EGG_BUS_DEBUG_CO_DIGIPOT_WIPER:
-        big_endian_copy_uint32_to_buffer((uint32_t) digipot_read_wiper0(), response);
-        break;
-    case EGG_BUS_DEBUG_DIGIPOT_STATUS:
-        big_endian_copy_uint32_to_buffer((uint32_t) digipot_read_status(), response);
-        blinkLEDs(1, POWER_LED);
-        break;
-#endif
-    default:
-        if(address >= EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS){
-            sensor_index = sensor_block_relative_address / ((uint16_t) EGG_BUS_SENSOR_BLOCK_SIZE);
-            sensor_field_offset = sensor_block_relative_address % ((uint16_t) EGG_BUS_SENSOR_BLOCK_SIZE);
-            switch(sensor_field_offset){
-            case EGG_BUS_SENSOR_BLOCK_TYPE_OFFSET:
-                egg_bus_get_sensor_type(sensor_index, (char *) response);
-                response_length = 16;
-                break;
-            case EGG_BUS_SENSOR_BLOCK_UNITS_OFFSET:
-                egg_bus_get_sensor_units(sensor_index, (char *) response);
-                response_length = 16;
-                break;
-            case EGG_BUS_SENSOR_BLOCK_R0_OFFSET:
-                big_endian_copy_uint32_to_buffer(egg_bus_get_r0_ohms(sensor_index), response);
-                break;
-            case EGG_BUS_SENSOR_BLOCK_TABLE_X_SCALER_OFFSET:
-                memcpy(&responseValue, get_p_x_scaler(sensor_index), 4);
-                big_endian_copy_uint32_to_buffer(responseValue, response);
-                break;
-            case EGG_BUS_SENSOR_BLOCK_TABLE_Y_SCALER_OFFSET:
-                memcpy(&responseValue, get_p_y_scaler(sensor_index), 4);
-                big_endian_copy_uint32_to_buffer(responseValue, response);
-                break;
-            case EGG_BUS_SENSOR_BLOCK_MEASURED_INDEPENDENT_SCALER_OFFSET:
-                memcpy(&responseValue, get_p_independent_scaler(sensor_index), 4);
-                big_endian_copy_uint32_to_buffer(responseValue, response);
-                break;
-            case EGG_BUS_SENSOR_BLOCK_MEASURED_INDEPENDENT_OFFSET:
-            case EGG_BUS_SENSOR_BLOCK_RAW_VALUE_OFFSET:
-                possible_low_side_resistances[0] = get_r1(sensor_index) + get_r2(sensor_index) + get_r3(sensor_index);
-                possible_low_side_resistances[1] = get_r1(sensor_index) + get_r2(sensor_index);
-                possible_low_side_resistances[2] = get_r1(sensor_index);
-
-                // R2 and R3 enabled
-                SENSOR_R2_ENABLE(sensor_index);
-                SENSOR_R3_ENABLE(sensor_index);
-                _delay_ms(10);
-                possible_values[0] = averageADC(sensor_index);
-
-                // R3 disabled
-                SENSOR_R3_DISABLE(sensor_index);
-                _delay_ms(10);
-                possible_values[1] = averageADC(sensor_index);
-
-                // R2 and R3 disabled
-                SENSOR_R2_DISABLE(sensor_index);
-                _delay_ms(10);
-                possible_values[2] = averageADC(sensor_index);
-
-                // figure out the "best value index" ... here's how this algorithm works:
-                // If the ADC reading when using the R1 + R2 + R3 chain is below THRESHOLD1 use that value
-                // else if the ADC reading when using the R1 + R2 chain is below THRESHOLD2 use that value
-                // else use the ADC reading using the R1 chain
-                if(possible_values[0] < get_r1r2r3_threshold(sensor_index)){
-                    best_value_index = 0;
-                }
-                else if(possible_values[1] < get_r1r2_threshold(sensor_index)){
-                    best_value_index = 1;
-                }
-                else{
-                    best_value_index = 2;
-                }
-
-                if(sensor_field_offset == EGG_BUS_SENSOR_BLOCK_RAW_VALUE_OFFSET){
-                    response_length = 8;
-                    big_endian_copy_uint32_to_buffer((uint32_t) possible_values[best_value_index], response);
-                    big_endian_copy_uint32_to_buffer((uint32_t) possible_low_side_resistances[best_value_index], response + 4 );
-                }
-                else{ // if sensor_field_offset == EGG_BUS_SENSOR_BLOCK_MEASURED_INDEPENDENT
-                      // in either case ... calculate the resistance
-                    uint32_t a = ((uint32_t) possible_values[best_value_index]) *  ADC_VCC_TENTH_VOLTS; // ADC_VCC * ADC
-                    uint32_t b = (1024L * ((uint32_t) get_sensor_vcc(sensor_index))); // 1024 * SENSOR_VCC
-                    if(a > b){
-                        responseValue = 0; // short circuit
-                    }
-                    else{
-                        // what we are computing is
-                        // R_SENSOR = R_LOW_SIDE * SENSOR_VCC * (1024 * SENSOR_VCC - ADC_VCC * ADC) / (ADC_VCC * SENSOR_VCC * ADC)
-                        //          = R_LOW_SIDE * SENSOR_VCC * (b - a) / (ADC_VCC * SENSOR_VCC * ADC)
-                        responseValue = b - a;
-
-                        // before we multiply by a potentially large value lets find out if it's going to make us overflow and avert that if possible
-                        if(possible_low_side_resistances[best_value_index] > (((uint32_t) 0xffffffff) / responseValue) ){
-                            if(possible_values[best_value_index] != 0){
-                                responseValue /= ((uint32_t) ADC_VCC_TENTH_VOLTS);                 // (b - a) / (ADC_VCC)
-                                responseValue *= possible_low_side_resistances[best_value_index];  // R_LOW_SIDE * (b - a) / (ADC_VCC)
-                                responseValue /= ((uint32_t) get_sensor_vcc(sensor_index) *
-                                        ((uint32_t) possible_values[best_value_index]));           // R_LOW_SIDE * (b - a) / (ADC_VCC * ADC * SENSOR_VCC)
-                                responseValue *= get_sensor_vcc(sensor_index);                     // R_LOW_SIDE * SENSOR_VCC * (b - a) / (ADC_VCC * ADC * SENSOR_VCC)
-                            }
-                            else{
-                                responseValue = 0xffffffff; // infinity
-                            }
-                        }
-                        else{
-                            responseValue *= possible_low_side_resistances[best_value_index];        // R_LOW_SIDE * (b - a)
-                            if(possible_values[best_value_index] != 0){
-                                responseValue /= ((uint32_t) possible_values[best_value_index]) *
-                                        ((uint32_t) ADC_VCC_TENTH_VOLTS *
-                                        ((uint32_t) get_sensor_vcc(sensor_index)));                // R_LOW_SIDE * (b - a) / (ADC * ADC_VCC * SENSOR_VCC)
-                                responseValue *= get_sensor_vcc(sensor_index);                     // R_LOW_SIDE * SENSOR_VCC * (b - a) / (ADC * ADC_VCC * SENSOR_VCC)
-                            }
-                            else{
-                                responseValue = 0xffffffff; // infinity
-                            }
-                        }
-                    }
-
-                    // the independent variable in either case is R_Sensed / R0
-                    //float_response = ((1.0 * responseValue) / egg_bus_get_r0_ohms(sensor_index));
-                    temp = responseValue;
-                    responseValue *= get_independent_scaler_inverse(sensor_index);
-                    if(temp > responseValue){
-                        // overflow the independent variable should be returned as big as possible
-                        responseValue = 0xffffffff; // infinity
-                    }
-                    else{
-                        responseValue /= egg_bus_get_r0_ohms(sensor_index);
-                    }
-                    big_endian_copy_uint32_to_buffer(responseValue, response);
-                }
-
-                break;
-            default: // assume its an access to the mapping table entries
-                sensor_block_relative_address = (sensor_field_offset - EGG_BUS_SENSOR_BLOCK_COMPUTED_VALUE_MAPPING_TABLE_BASE_OFFSET);
-                sensor_block_relative_address >>= 3; // divide by eight - now it is the mapping table index
-                response_length = 2;
-
-                *(response)   = getTableValue(sensor_index, sensor_block_relative_address, 0);
-                *(response+1) = getTableValue(sensor_index, sensor_block_relative_address, 1);
-
-                break;
-            }
+    uint8_t span = registers_get_span(address) & ~FIELD_SPAN_NOT_STREAMED;
+
+    // if the master keeps clocking bytes out, the fields after this one follow
+    stream_address = address + (span != 0 ? span : 1);
+
+    // a prepared response is only good once, a master that reads the same address again
+    // without a new READ gets fresh data
+    if(!response_prepared){
+        registers_get_source(address, &response_source, response);
+    }
+    response_prepared = 0;
+
+    twi_transmitSource(&response_source);
+
+    if(egg_bus_get_config() & EGG_BUS_CONFIG_PEC){
+        pec_crc = 0;
+        for(uint8_t ii = 0; ii < response_source.length; ii++){
+            pec_crc = egg_bus_crc8_update(pec_crc, twi_sourceByte(&response_source, ii));
         }
-        break;
+        pec_pending = 1;
     }
+}
 
-    // write the value back to the master per the protocol requirements
-    // the response is always four bytes, most significant byte first
-    twi_transmit(response, response_length);
+/* this gets called when the master reads past the end of what has been sent so far
+ * the register map streams out in address order with every field taking up exactly its span,
+ * padded with zeros or cut short to fit, so byte n of the stream is at stream start + n
+ * (only the first field, served by onRequestService, goes out at its full length) */
+void onRequestRefillService(void){
+    uint8_t span = registers_get_span(stream_address);
+
+    // with PEC on a read is one field and its CRC, there is no stream after that
+    if(egg_bus_get_config() & EGG_BUS_CONFIG_PEC){
+        if(pec_pending){
+            pec_pending = 0;
+            response_source.type = TWI_SOURCE_RAM;
+            response_source.length = 1;
+            response_source.data = &pec_crc;
+            twi_transmitSource(&response_source);
+        }
+        return;
+    }
+
+    if(span == 0 || (span & FIELD_SPAN_NOT_STREAMED)){
+        // nothing lives here, or nothing that can be streamed, so zeros
+        memset(response, 0, EGG_BUS_MAX_RESPONSE_LENGTH);
+        response_source.type = TWI_SOURCE_RAM;
+        response_source.data = response;
+        span = span == 0 ? 1 : span & ~FIELD_SPAN_NOT_STREAMED;
+    }
+    else{
+        registers_get_source(stream_address, &response_source, response);
+    }
+
+    // the response buffer is zeroed past the value, and anything sent from where it lives is exactly its span long
+    response_source.length = span;
+    stream_address += span;
+    twi_transmitSource(&response_source);
 }
 
 // this gets called when you get an SLA+W  then numBytes bytes, then stop
 //   numBytes bytes have been buffered in inBytes by the twi library
 // it seems quite critical that we not dilly-dally in this function, get in and get out ASAP
 void onReceiveService(uint8_t* inBytes, int numBytes){
-    uint8_t command = inBytes[0];
-    uint16_t address = (((uint16_t) inBytes[1]) << 8) | inBytes[2];
+    uint8_t length = (uint8_t) numBytes;
+    uint8_t command = 0;
+    uint16_t address = 0;
     uint32_t value = 0;
-    uint8_t sensor_index = 0;
-    uint8_t sensor_field_offset = 0;
-    uint16_t sensor_block_relative_address = address - ((uint16_t) EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS);
     uint8_t ii = 0;
 
     POWER_LED_TOGGLE();
+
+    // anything written may change what a prepared response should say
+    response_prepared = 0;
+
+    // with PEC on, a frame that fails the check is dropped whole, address and all
+    if(!egg_bus_check_pec(inBytes, length)){
+        return;
+    }
+
+    // the CRC isn't part of the frame proper (the check above makes sure there is one)
+    if(egg_bus_get_config() & EGG_BUS_CONFIG_PEC){
+        length--;
+    }
+
+    // frames too short for a command and address are dropped too, the bytes
+    // past the end of what was received are left over from an earlier frame
+    if(length < EGG_BUS_READ_FRAME_LENGTH){
+        return;
+    }
+
+    command = inBytes[0];
+    address = (((uint16_t) inBytes[1]) << 8) | inBytes[2];
+
     switch(command){
     case EGG_BUS_COMMAND_READ:
         egg_bus_set_read_address(address);
+        // fields whose reads have side effects wait for the actual SLA+R
+        if(!(registers_get_span(address) & FIELD_SPAN_NOT_STREAMED)){
+            registers_get_source(address, &response_source, response);
+            response_prepared = 1;
+        }
         break;
     case EGG_BUS_COMMAND_WRITE:
         // The write command always has a 2-byte address
-        // then the data in big-endian byte order
-        // so numBytes must be at least 4 (command, address high, address low, value byte N-1, ..., value byte 0)
-        if(address >= EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS){
-            sensor_index = sensor_block_relative_address / ((uint16_t) EGG_BUS_SENSOR_BLOCK_SIZE);
-            sensor_field_offset = sensor_block_relative_address % ((uint16_t) EGG_BUS_SENSOR_BLOCK_SIZE);
-            switch(sensor_field_offset){
-            case EGG_BUS_SENSOR_BLOCK_R0_OFFSET:
-                // rebuild the value
-                value = inBytes[3];
-                for(ii = 4; ii < 7; ii++){
-                    value <<= 8;
-                    value |= inBytes[ii];
-                }
-
-                // store the value
-                egg_bus_set_r0_ohms(sensor_index, value);
-                break;
-            }
+        // then the 4 data bytes in big-endian byte order
+        // (command, address high, address low, value byte 3, ..., value byte 0)
+        // (with PEC on the CRC comes after the value)
+        if(length < EGG_BUS_WRITE_FRAME_LENGTH){
+            break;
+        }
+
+        // rebuild the value
+        value = inBytes[3];
+        for(ii = 4; ii < EGG_BUS_WRITE_FRAME_LENGTH; ii++){
+            value <<= 8;
+            value |= inBytes[ii];
         }
 
+        // the register table knows which fields are writable and what range they take,
+        // anything slow (like R0 going to EEPROM) gets queued for the main loop
+        registers_write(address, value);
         break;
     }
 }
@@ -306,18 +242,24 @@ void onReceiveService(uint8_t* inBytes, int numBytes){
 void setup(void){
     POWER_LED_INIT();
     STATUS_LED_INIT();
-    POWER_LED_ON();
-    delay_sec(1);
+    POWER_LED_ON(); // on while we start up
 
     unio_init(NANODE_MAC_DEVICE);
     unio_read(macaddr, NANODE_MAC_ADDRESS, 6);
 
+    egg_bus_init();
+
     // TWI Initialize
     twi_setAddress(TWI_SLAVE_ADDRESS);
     twi_attachSlaveTxEvent(onRequestService);
+    twi_attachSlaveTxRefillEvent(onRequestRefillService);
     twi_attachSlaveRxEvent(onReceiveService);
     twi_init();
 
+    timer_init();
+    profile_init();
+    alarm_init();
+
     // enable the adjustable regulators
     NO2_HEATER_INIT();
     CO_HEATER_INIT();
@@ -332,19 +274,26 @@ void setup(void){
 
     POWER_LED_OFF();
 
+    // nothing uses the analog comparator, stop it drawing current in between tasks
+    ACSR |= _BV(ACD);
+
     spi_begin();
     digipot_init();
 
-    blinkLEDs(1, STATUS_LED);
-    STATUS_LED_OFF();
+    setup_adc();
 }
 
-#define NUM_ADC_READINGS_TO_AVERAGE 100L
-uint16_t averageADC(uint8_t sensor_index){
-    uint32_t ret = 0;
-    for(uint8_t ii = 0; ii < NUM_ADC_READINGS_TO_AVERAGE; ii++){
-        ret += analogRead(egg_bus_map_to_analog_pin(sensor_index));
+/* the conversion sequence, the sensor channels from the egg bus mapping and the heater power/feedback
+ * channels from the heater config. the ADC task runs through all of it every SCHEDULER_ADC_PERIOD_MS,
+ * the sampler's own reads of a sensor channel go into the same rings in between */
+void setup_adc(void){
+    uint8_t channels[3 * EGG_BUS_NUM_HOSTED_SENSORS];
+
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        channels[3 * ii]     = egg_bus_map_to_analog_pin(ii);
+        channels[3 * ii + 1] = heater_control_get_power_adc_channel(ii);
+        channels[3 * ii + 2] = heater_control_get_feedback_adc_channel(ii);
     }
 
-    return (uint16_t) (ret / NUM_ADC_READINGS_TO_AVERAGE);
+    adc_init(channels, 3 * EGG_BUS_NUM_HOSTED_SENSORS);
 }
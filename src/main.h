@@ -18,6 +18,8 @@
 #define CO_HEATER_FEEDBACK_RESISTANCE 10L // ohms
 #define CO_HEATER_TARGET_POWER_MW  76L // mW
 
-uint16_t averageADC(uint8_t sensor_index);
+#include <stdint.h>
+
+extern uint8_t macaddr[6];
 
 #endif /* MAIN_H_ */
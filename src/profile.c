@@ -0,0 +1,143 @@
+/*
+ * profile.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+#include "profile.h"
+#include "utility.h"
+
+/* times stretches of code in CPU cycles off Timer1, free running at the full clock.
+ * it is 16 bits, so anything longer than 65535 cycles (65ms @ 1MHz) comes out short,
+ * and it stops along with the I/O clock while analogRead sleeps in ADC noise reduction mode.
+ * nothing else uses Timer1, so this is the one place that powers it up or down */
+
+/* the mean is a running one, each new sample counts for 1 / count of it up to PROFILE_MEAN_SAMPLES
+ * and 1 / PROFILE_MEAN_SAMPLES after that, so it follows the last few dozen samples without a 32 bit sum */
+#define PROFILE_MEAN_SAMPLES 16
+
+typedef struct{
+    uint16_t min;
+    uint16_t max;
+    uint16_t mean;
+    uint16_t count; // samples so far, sticks at 0xffff
+} profile_point_t;
+
+#if PROFILE_ENABLED
+static profile_point_t profile_points[PROFILE_NUM_POINTS];
+
+/* total time SCL has been held low since start up, per TWI interrupt it is PROFILE_TWI_ENTRY_CYCLES
+ * plus the time from the start of the ISR to the TWCR write that cleared TWINT. not counted: time the
+ * interrupt had to wait behind another ISR or an ATOMIC_BLOCK before it got going */
+static uint32_t profile_stretch_cycles = 0;
+static uint16_t profile_twi_released_at = 0;
+static uint8_t profile_twi_released_flag = 0;
+#endif
+
+void profile_init(void){
+#if PROFILE_ENABLED
+    for(uint8_t ii = 0; ii < PROFILE_NUM_POINTS; ii++){
+        profile_points[ii].min = 0xffff;
+    }
+
+    // Timer1 on, normal mode, no prescaler, no interrupts
+    PRR &= ~_BV(PRTIM1);
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+#else
+    // no profiling, so stop Timer1 drawing current
+    PRR |= _BV(PRTIM1);
+#endif
+}
+
+uint16_t profile_start(void){
+    uint16_t ret = 0;
+#if PROFILE_ENABLED
+    // the high byte goes through a temporary register shared by all the 16 bit Timer1 registers
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        ret = TCNT1;
+    }
+#endif
+    return ret;
+}
+
+// safe to call from the main loop and from ISRs
+void profile_stop(uint8_t point, uint16_t start){
+#if PROFILE_ENABLED
+    profile_point_t * p = &profile_points[point];
+    int32_t delta = 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        uint16_t cycles = TCNT1 - start;
+
+        if(cycles < p->min){
+            p->min = cycles;
+        }
+        if(cycles > p->max){
+            p->max = cycles;
+        }
+        if(p->count != 0xffff){
+            p->count++;
+        }
+        // a constant divisor once the mean is going, that's a few shifts rather than a division in the ISR
+        delta = (int32_t) cycles - (int32_t) p->mean;
+        if(p->count < PROFILE_MEAN_SAMPLES){
+            p->mean += delta / (int16_t) p->count;
+        }
+        else{
+            p->mean += delta / PROFILE_MEAN_SAMPLES;
+        }
+
+        if(point == PROFILE_TWI_ISR && profile_twi_released_flag){
+            profile_stretch_cycles += (uint16_t) (profile_twi_released_at - start) + PROFILE_TWI_ENTRY_CYCLES;
+            profile_twi_released_flag = 0;
+        }
+    }
+#else
+    (void) point;
+    (void) start;
+#endif
+}
+
+// min, max, mean and sample count, big endian, PROFILE_POINT_LENGTH bytes
+void profile_copy_point(uint8_t point, uint8_t * buffer){
+#if PROFILE_ENABLED
+    profile_point_t p;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        p = profile_points[point];
+    }
+#else
+    profile_point_t p = { 0, 0, 0, 0 };
+    (void) point;
+#endif
+
+    big_endian_copy_uint16_to_buffer(p.count == 0 ? 0 : p.min, buffer);
+    big_endian_copy_uint16_to_buffer(p.max, buffer + 2);
+    big_endian_copy_uint16_to_buffer(p.mean, buffer + 4);
+    big_endian_copy_uint16_to_buffer(p.count, buffer + 6);
+}
+
+// twi.c calls this straight after each TWCR write that clears TWINT and lets go of SCL,
+// so the stretch it marks the end of comes out a few cycles long, never short
+void profile_twi_released(void){
+#if PROFILE_ENABLED
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        profile_twi_released_at = TCNT1;
+        profile_twi_released_flag = 1;
+    }
+#endif
+}
+
+uint32_t profile_get_stretch_cycles(void){
+    uint32_t ret = 0;
+#if PROFILE_ENABLED
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        ret = profile_stretch_cycles;
+    }
+#endif
+    return ret;
+}
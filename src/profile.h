@@ -0,0 +1,46 @@
+/*
+ * profile.h
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+
+// Timer1 belongs to the profiling. it is built in by default, -DPROFILE_ENABLED=0 gets back the
+// 47 bytes of RAM the counters take, Timer1 then stays switched off in PRR and the profile
+// registers read back as zeros
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 1
+#endif
+
+/* SCL is held low from the moment TWINT is set until the ISR writes TWCR to clear it. the part
+ * before the ISR's first reading of Timer1 can't be timed from the inside, so it is counted as
+ * this many cycles: 4 to respond to the interrupt (8 out of sleep), the rjmp in the vector table,
+ * the prologue pushing the call clobbered registers and the call into profile_start.
+ * check it against the ISR(TWI_vect) listing in avr-objdump -d when the compiler changes */
+#ifndef PROFILE_TWI_ENTRY_CYCLES
+#define PROFILE_TWI_ENTRY_CYCLES   48
+#endif
+
+// the code that gets timed
+#define PROFILE_TWI_ISR            0
+#define PROFILE_TWI_ON_REQUEST     1 // onRequestService, inside the TWI ISR
+#define PROFILE_TWI_ON_RECEIVE     2 // onReceiveService, inside the TWI ISR
+#define PROFILE_AVERAGE_ADC        3
+#define PROFILE_HEATER_CONTROL     4 // heater_control_manage
+#define PROFILE_NUM_POINTS         5
+
+// what one point reads back as over the Egg Bus: min, max, mean and sample count, 16 bits each
+#define PROFILE_POINT_LENGTH       8
+
+void profile_init(void);
+uint16_t profile_start(void);
+void profile_stop(uint8_t point, uint16_t start);
+void profile_copy_point(uint8_t point, uint8_t * buffer);
+void profile_twi_released(void);
+uint32_t profile_get_stretch_cycles(void);
+
+#endif /* PROFILE_H_ */
@@ -0,0 +1,594 @@
+/*
+ * registers.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "registers.h"
+#include "main.h"
+#include "egg_bus.h"
+#include "utility.h"
+#include "digipot.h"
+#include "heater_control.h"
+#include "interpolation.h"
+#include "sampler.h"
+#include "filter.h"
+#include "history.h"
+#include "stats.h"
+#include "alarm.h"
+#include "command_queue.h"
+#include "scheduler.h"
+#include "profile.h"
+
+//#define INCLUDE_DEBUG_REGISTERS
+
+#define REGISTERS_COUNT(table) (sizeof(table) / sizeof(register_descriptor_t))
+#define REGISTERS_MAPPING_TABLE_LENGTH ((EGG_BUS_SENSOR_BLOCK_SAMPLE_AGE_OFFSET - EGG_BUS_SENSOR_BLOCK_COMPUTED_VALUE_MAPPING_TABLE_BASE_OFFSET + 7) / 8)
+#define REGISTERS_RAW_VALUE_LENGTH 9 // ADC value, low side resistance and ADC bits
+#if EGG_BUS_SCHEDULER_TASK_PERIODS + 4 * SCHEDULER_NUM_TASKS > EGG_BUS_SCHEDULER_IDLE_PERMILLE
+#error "the task period registers run into the idle registers"
+#endif
+
+#define REGISTERS_BIG_ENDIAN(value) { (uint8_t) ((value) >> 24), (uint8_t) ((value) >> 16), (uint8_t) ((value) >> 8), (uint8_t) (value) }
+
+static const uint8_t registers_firmware_version[4] PROGMEM = REGISTERS_BIG_ENDIAN(EGG_BUS_FIRMWARE_VERSION_NUMBER);
+static const uint8_t registers_capabilities[4] PROGMEM = REGISTERS_BIG_ENDIAN(EGG_BUS_CAPABILITIES_VALUE);
+
+/* header fields */
+
+static uint8_t registers_read_sensor_count(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    response[0] = EGG_BUS_NUM_HOSTED_SENSORS;
+    return 1;
+}
+
+static void registers_source_module_id(uint8_t sensor_index, uint8_t element, twi_source_t * source){
+    // only ever written in setup
+    source->type = TWI_SOURCE_RAM;
+    source->length = 6;
+    source->data = macaddr;
+}
+
+static void registers_source_firmware_version(uint8_t sensor_index, uint8_t element, twi_source_t * source){
+    source->type = TWI_SOURCE_PROGMEM;
+    source->length = 4;
+    source->data = registers_firmware_version;
+}
+
+static void registers_source_capabilities(uint8_t sensor_index, uint8_t element, twi_source_t * source){
+    source->type = TWI_SOURCE_PROGMEM;
+    source->length = 4;
+    source->data = registers_capabilities;
+}
+
+static uint8_t registers_read_config(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer((uint32_t) egg_bus_get_config(), response);
+    return 4;
+}
+
+static void registers_write_config(uint8_t sensor_index, uint8_t element, uint32_t value){
+    egg_bus_set_config((uint8_t) value);
+}
+
+static uint8_t registers_read_pec_error_count(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer(egg_bus_get_pec_error_count(), response);
+    return 4;
+}
+
+static uint8_t registers_read_command_queue_status(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    response[0] = command_queue_get_depth();
+    response[1] = command_queue_get_high_water();
+    response[2] = COMMAND_QUEUE_LENGTH;
+    return 4;
+}
+
+static uint8_t registers_read_command_queue_overflow_count(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer(command_queue_get_overflow_count(), response);
+    return 4;
+}
+
+static uint8_t registers_read_snapshot_frame(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    // every sensor's latest reading and heater state from one pass of the main loop
+    sampler_copy_snapshot(response);
+    return SAMPLER_SNAPSHOT_LENGTH;
+}
+
+static uint8_t registers_read_scheduler_period(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer((uint32_t) scheduler_get_period(element), response);
+    return 4;
+}
+
+static void registers_write_scheduler_period(uint8_t sensor_index, uint8_t element, uint32_t value){
+    scheduler_set_period(element, value > SCHEDULER_MAX_PERIOD_MS ? SCHEDULER_MAX_PERIOD_MS : (uint16_t) value);
+}
+
+static uint8_t registers_read_scheduler_idle_permille(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer((uint32_t) scheduler_get_idle_permille(), response);
+    return 4;
+}
+
+static uint8_t registers_read_scheduler_idle_ms(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer(scheduler_get_idle_ms(), response);
+    return 4;
+}
+
+// in the debug block, but like the profiling they are there whatever INCLUDE_DEBUG_REGISTERS says
+static uint8_t registers_read_wake_counts(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer(scheduler_get_wake_count(element), response);
+    return 4;
+}
+
+#ifdef INCLUDE_DEBUG_REGISTERS
+// four registers per heater, NO2 first: heater voltage+, heater voltage-, heater power, digipot wiper
+static uint8_t registers_read_heater_debug(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    uint32_t value = 0;
+    sensor_index = element >> 2;
+    switch(element & 3){
+    case 0:
+        value = heater_control_get_heater_power_voltage(sensor_index);
+        break;
+    case 1:
+        value = heater_control_get_heater_feedback_voltage(sensor_index);
+        break;
+    case 2:
+        value = heater_control_get_heater_power_mw(sensor_index);
+        break;
+    case 3:
+        // NO2 is on wiper 1, CO on wiper 0, served from the shadow rather than over SPI
+        value = digipot_get_wiper(sensor_index == 0 ? DIGIPOT_WIPER1 : DIGIPOT_WIPER0);
+        break;
+    }
+    big_endian_copy_uint32_to_buffer(value, response);
+    return 4;
+}
+
+static uint8_t registers_read_digipot_status(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    // from the shadow the heater task keeps, SPI has no business in the TWI ISR
+    big_endian_copy_uint32_to_buffer((uint32_t) digipot_get_status(), response);
+    POWER_LED_TOGGLE(); // a blink would busy wait in the TWI ISR
+    return 4;
+}
+#endif
+
+// the profiling registers are there whatever INCLUDE_DEBUG_REGISTERS says, they only read zeros in a -DPROFILE_ENABLED=0 build
+static uint8_t registers_read_profile_point(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    profile_copy_point(element, response);
+    return PROFILE_POINT_LENGTH;
+}
+
+static uint8_t registers_read_profile_stretch_cycles(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer(profile_get_stretch_cycles(), response);
+    return 4;
+}
+
+/* sensor block fields */
+
+// a string in flash, padded out with zeros
+static uint8_t registers_string_byte(const void * string, uint8_t index){
+    return index < strlen_P((PGM_P) string) ? pgm_read_byte((PGM_P) string + index) : 0;
+}
+
+static void registers_source_type(uint8_t sensor_index, uint8_t element, twi_source_t * source){
+    source->type = TWI_SOURCE_GENERATOR;
+    source->length = 16;
+    source->data = egg_bus_get_sensor_type_P(sensor_index);
+    source->generator = registers_string_byte;
+}
+
+static void registers_source_units(uint8_t sensor_index, uint8_t element, twi_source_t * source){
+    source->type = TWI_SOURCE_GENERATOR;
+    source->length = 16;
+    source->data = egg_bus_get_sensor_units_P(sensor_index);
+    source->generator = registers_string_byte;
+}
+
+static uint8_t registers_read_r0(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer(egg_bus_get_r0_ohms(sensor_index), response);
+    return 4;
+}
+
+// deferred, it ends up in EEPROM
+static void registers_write_r0(uint8_t sensor_index, uint8_t element, uint32_t value){
+    egg_bus_set_r0_ohms(sensor_index, value);
+}
+
+static uint8_t registers_read_measured_independent(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    sensor_sample_t sample;
+    // served from the sample cache, the measurement itself happens in the main loop
+    sampler_get_sample(sensor_index, &sample);
+    big_endian_copy_uint32_to_buffer(sample.valid ? sample.independent_value : 0xffffffff, response);
+    return 4;
+}
+
+// the scalers are constant floats in flash, sent most significant byte first
+static void registers_source_x_scaler(uint8_t sensor_index, uint8_t element, twi_source_t * source){
+    source->type = TWI_SOURCE_PROGMEM_REVERSED;
+    source->length = 4;
+    source->data = get_p_x_scaler(sensor_index);
+}
+
+static uint8_t registers_read_raw_value(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    sensor_sample_t sample;
+    sampler_get_sample(sensor_index, &sample);
+    big_endian_copy_uint32_to_buffer((uint32_t) sample.adc_value, response);
+    big_endian_copy_uint32_to_buffer(sampler_get_low_side_resistance(sensor_index, sample.range_index), response + 4);
+    response[8] = sample.adc_bits; // the ADC value has more than 10 bits when oversampling
+    return REGISTERS_RAW_VALUE_LENGTH;
+}
+
+static void registers_source_y_scaler(uint8_t sensor_index, uint8_t element, twi_source_t * source){
+    source->type = TWI_SOURCE_PROGMEM_REVERSED;
+    source->length = 4;
+    source->data = get_p_y_scaler(sensor_index);
+}
+
+static void registers_source_independent_scaler(uint8_t sensor_index, uint8_t element, twi_source_t * source){
+    source->type = TWI_SOURCE_PROGMEM_REVERSED;
+    source->length = 4;
+    source->data = get_p_independent_scaler(sensor_index);
+}
+
+static uint8_t registers_read_mapping_table(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    response[0] = getTableValue(sensor_index, element, 0);
+    response[1] = getTableValue(sensor_index, element, 1);
+    return 2;
+}
+
+static uint8_t registers_read_sample_age(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer(sampler_get_age_ms(sensor_index), response);
+    return 4;
+}
+
+static uint8_t registers_read_oversampling(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer((uint32_t) sampler_get_oversampling(sensor_index), response);
+    return 4;
+}
+
+static void registers_write_oversampling(uint8_t sensor_index, uint8_t element, uint32_t value){
+    // 0 for the plain average or n for 4^n readings at 10 + n bits
+    sampler_set_oversampling(sensor_index, value > SAMPLER_MAX_OVERSAMPLING ? SAMPLER_MAX_OVERSAMPLING : (uint8_t) value);
+}
+
+static uint8_t registers_read_settle_times(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    // last measured settle time in microseconds (to the nearest 64) for each range, R1 + R2 + R3 first
+    for(uint8_t ii = 0; ii < SAMPLER_NUM_RANGES; ii++){
+        big_endian_copy_uint32_to_buffer((uint32_t) sampler_get_settle_time_us(sensor_index, ii), response + 4 * ii);
+    }
+    return 4 * SAMPLER_NUM_RANGES;
+}
+
+static uint8_t registers_read_computed_value(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    sensor_sample_t sample;
+    // the interpolated value in the sensor's units, so the master doesn't have to walk the table
+    sampler_get_sample(sensor_index, &sample);
+    big_endian_copy_uint32_to_buffer(sample.valid ? sample.computed_value : 0xffffffff, response);
+    return 4;
+}
+
+static uint8_t registers_read_filter_median_length(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer((uint32_t) filter_get_median_length(sensor_index), response);
+    return 4;
+}
+
+static void registers_write_filter_median_length(uint8_t sensor_index, uint8_t element, uint32_t value){
+    // 1 turns the median off, otherwise an odd number of points up to FILTER_MAX_MEDIAN_LENGTH
+    filter_set_median_length(sensor_index, value > FILTER_MAX_MEDIAN_LENGTH ? FILTER_MAX_MEDIAN_LENGTH : (uint8_t) value);
+}
+
+static uint8_t registers_read_filter_ewma_shift(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer((uint32_t) filter_get_ewma_shift(sensor_index), response);
+    return 4;
+}
+
+static void registers_write_filter_ewma_shift(uint8_t sensor_index, uint8_t element, uint32_t value){
+    // 0 turns the average off, n weighs each new value by 1 / 2^n
+    filter_set_ewma_shift(sensor_index, value > FILTER_MAX_EWMA_SHIFT ? FILTER_MAX_EWMA_SHIFT : (uint8_t) value);
+}
+
+static uint8_t registers_read_filtered_value(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    sensor_sample_t sample;
+    // the measured independent value after the median and EWMA stages, the filter keeps it
+    sampler_get_sample(sensor_index, &sample);
+    big_endian_copy_uint32_to_buffer(sample.valid ? filter_get_output(sensor_index) : 0xffffffff, response);
+    return 4;
+}
+
+static uint8_t registers_read_history_interval(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer((uint32_t) history_get_interval(sensor_index), response);
+    return 4;
+}
+
+static void registers_write_history_interval(uint8_t sensor_index, uint8_t element, uint32_t value){
+    // in history ticks of 1.024 seconds, 0 keeps every sample
+    history_set_interval(sensor_index, value > 0xffff ? 0xffff : (uint16_t) value);
+}
+
+static uint8_t registers_read_history_info(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    history_get_info(sensor_index, response);
+    return HISTORY_INFO_LENGTH;
+}
+
+static uint8_t registers_read_history_entries(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    // as many history entries as fit in a response, starting with the one at this address
+    return history_copy_entries(sensor_index, element, response, EGG_BUS_MAX_RESPONSE_LENGTH);
+}
+
+static uint8_t registers_read_stats_min(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    stats_summary_t summary;
+    stats_get_summary(sensor_index, &summary, 0);
+    big_endian_copy_uint32_to_buffer((uint32_t) summary.min, response);
+    return 4;
+}
+
+static uint8_t registers_read_stats_max(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    stats_summary_t summary;
+    stats_get_summary(sensor_index, &summary, 0);
+    big_endian_copy_uint32_to_buffer((uint32_t) summary.max, response);
+    return 4;
+}
+
+static uint8_t registers_read_stats_mean(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    stats_summary_t summary;
+    stats_get_summary(sensor_index, &summary, 0);
+    big_endian_copy_uint32_to_buffer(summary.mean_q8, response);
+    return 4;
+}
+
+static uint8_t registers_read_stats_variance(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    stats_summary_t summary;
+    stats_get_summary(sensor_index, &summary, 0);
+    big_endian_copy_uint32_to_buffer(summary.variance_q8, response);
+    return 4;
+}
+
+static uint8_t registers_read_stats_count(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    stats_summary_t summary;
+    stats_get_summary(sensor_index, &summary, 0);
+    big_endian_copy_uint32_to_buffer((uint32_t) summary.count, response);
+    return 4;
+}
+
+static uint8_t registers_read_stats_window(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer((uint32_t) stats_get_window(sensor_index), response);
+    return 4;
+}
+
+static void registers_write_stats_window(uint8_t sensor_index, uint8_t element, uint32_t value){
+    // in samples, 0 runs until the snapshot register is read, either way the window starts over
+    stats_set_window(sensor_index, value > 0xffff ? 0xffff : (uint16_t) value);
+}
+
+static uint8_t registers_read_stats_snapshot(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    // everything above in one read, and the window starts over
+    stats_copy_snapshot(sensor_index, response);
+    return STATS_SNAPSHOT_LENGTH;
+}
+
+static uint8_t registers_read_alarm_threshold(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer(alarm_get_threshold(sensor_index), response);
+    return 4;
+}
+
+static void registers_write_alarm_threshold(uint8_t sensor_index, uint8_t element, uint32_t value){
+    // in the same units as the computed value
+    alarm_set_threshold(sensor_index, value);
+}
+
+static uint8_t registers_read_alarm_config(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer((uint32_t) alarm_get_config(sensor_index), response);
+    return 4;
+}
+
+static void registers_write_alarm_config(uint8_t sensor_index, uint8_t element, uint32_t value){
+    // the status bits that should pull the alert line low
+    alarm_set_config(sensor_index, (uint8_t) value);
+}
+
+static uint8_t registers_read_alarm_status(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer((uint32_t) alarm_get_status(sensor_index), response);
+    return 4;
+}
+
+static void registers_write_alarm_status(uint8_t sensor_index, uint8_t element, uint32_t value){
+    // write ones to clear the corresponding latched bits
+    alarm_clear_status(sensor_index, (uint8_t) value);
+}
+
+static uint8_t registers_read_heater_kp(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer((uint32_t) heater_control_get_kp(sensor_index), response);
+    return 4;
+}
+
+static void registers_write_heater_kp(uint8_t sensor_index, uint8_t element, uint32_t value){
+    // in 1/256 wiper steps per mW change in the error
+    heater_control_set_kp(sensor_index, value > 0xffff ? 0xffff : (uint16_t) value);
+}
+
+static uint8_t registers_read_heater_ki(uint8_t sensor_index, uint8_t element, uint8_t * response){
+    big_endian_copy_uint32_to_buffer((uint32_t) heater_control_get_ki(sensor_index), response);
+    return 4;
+}
+
+static void registers_write_heater_ki(uint8_t sensor_index, uint8_t element, uint32_t value){
+    // in 1/256 wiper steps per mW of error, every heater update
+    heater_control_set_ki(sensor_index, value > 0xffff ? 0xffff : (uint16_t) value);
+}
+
+// everything outside the sensor blocks, sorted by address
+static const register_descriptor_t registers_header_table[] PROGMEM = {
+    { EGG_BUS_ADDRESS_SENSOR_COUNT,          1, 0, 1, registers_read_sensor_count, 0, 0 },
+    { EGG_BUS_ADDRESS_MODULE_ID,             1, 0, 6, 0, registers_source_module_id, 0 },
+    { EGG_BUS_FIRMWARE_VERSION,              1, 0, 4, 0, registers_source_firmware_version, 0 },
+    { EGG_BUS_CAPABILITIES,                  1, 0, 4, 0, registers_source_capabilities, 0 },
+    { EGG_BUS_CONFIG,                        1, 0, 4, registers_read_config, 0, registers_write_config },
+    { EGG_BUS_PEC_ERROR_COUNT,               1, 0, 4, registers_read_pec_error_count, 0, 0 },
+    { EGG_BUS_COMMAND_QUEUE_STATUS,          1, 0, 4, registers_read_command_queue_status, 0, 0 },
+    { EGG_BUS_COMMAND_QUEUE_OVERFLOW_COUNT,  1, 0, 4, registers_read_command_queue_overflow_count, 0, 0 },
+    { EGG_BUS_SNAPSHOT_FRAME,                1, 0, SAMPLER_SNAPSHOT_LENGTH, registers_read_snapshot_frame, 0, 0 },
+    { EGG_BUS_SCHEDULER_TASK_PERIODS,        SCHEDULER_NUM_TASKS, 2, 4, registers_read_scheduler_period, 0, registers_write_scheduler_period, REGISTER_WRITE_DEFERRED },
+    { EGG_BUS_SCHEDULER_IDLE_PERMILLE,       1, 0, 4, registers_read_scheduler_idle_permille, 0, 0 },
+    { EGG_BUS_SCHEDULER_IDLE_MS,             1, 0, 4, registers_read_scheduler_idle_ms, 0, 0 },
+#ifdef INCLUDE_DEBUG_REGISTERS
+    { EGG_BUS_DEBUG_NO2_HEATER_VOLTAGE_PLUS, 4 * EGG_BUS_NUM_HOSTED_SENSORS, 2, 4, registers_read_heater_debug, 0, 0 },
+    { EGG_BUS_DEBUG_DIGIPOT_STATUS,          1, 0, 4, registers_read_digipot_status, 0, 0 },
+#endif
+    { EGG_BUS_DEBUG_WAKE_COUNTS,             SCHEDULER_NUM_WAKE_SOURCES, 2, 4, registers_read_wake_counts, 0, 0 },
+    { EGG_BUS_DEBUG_PROFILE_POINTS,          PROFILE_NUM_POINTS, 3, PROFILE_POINT_LENGTH, registers_read_profile_point, 0, 0 },
+    { EGG_BUS_DEBUG_PROFILE_STRETCH_CYCLES,  1, 0, 4, registers_read_profile_stretch_cycles, 0, 0 },
+    { EGG_BUS_DEBUG_PROFILE_IDLE_PERMILLE,   1, 0, 4, registers_read_scheduler_idle_permille, 0, 0 },
+};
+
+// the fields of one sensor block, by offset into the block and sorted by it
+static const register_descriptor_t registers_sensor_table[] PROGMEM = {
+    { EGG_BUS_SENSOR_BLOCK_TYPE_OFFSET,                         1, 0, 16, 0, registers_source_type, 0 },
+    { EGG_BUS_SENSOR_BLOCK_UNITS_OFFSET,                        1, 0, 16, 0, registers_source_units, 0 },
+    { EGG_BUS_SENSOR_BLOCK_R0_OFFSET,                           1, 0, 4, registers_read_r0, 0, registers_write_r0, REGISTER_WRITE_DEFERRED },
+    { EGG_BUS_SENSOR_BLOCK_MEASURED_INDEPENDENT_OFFSET,         1, 0, 4, registers_read_measured_independent, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_TABLE_X_SCALER_OFFSET,               1, 0, 4, 0, registers_source_x_scaler, 0 },
+    // 9 bytes long, it runs over the y scaler and the first byte of the independent scaler,
+    // so a stream through it carries on at 53 with zeros up to the mapping table
+    { EGG_BUS_SENSOR_BLOCK_RAW_VALUE_OFFSET,                    1, 0, REGISTERS_RAW_VALUE_LENGTH, registers_read_raw_value, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_TABLE_Y_SCALER_OFFSET,               1, 0, 4, 0, registers_source_y_scaler, 0 },
+    { EGG_BUS_SENSOR_BLOCK_MEASURED_INDEPENDENT_SCALER_OFFSET,  1, 0, 4, 0, registers_source_independent_scaler, 0 },
+    // one mapping table entry every 8 addresses up to the sample age
+    { EGG_BUS_SENSOR_BLOCK_COMPUTED_VALUE_MAPPING_TABLE_BASE_OFFSET, REGISTERS_MAPPING_TABLE_LENGTH, 3, 8, registers_read_mapping_table, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_SAMPLE_AGE_OFFSET,                   1, 0, 4, registers_read_sample_age, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_OVERSAMPLING_OFFSET,                 1, 0, 4, registers_read_oversampling, 0, registers_write_oversampling, REGISTER_WRITE_DEFERRED },
+    { EGG_BUS_SENSOR_BLOCK_SETTLE_TIMES_OFFSET,                 1, 0, 4 * SAMPLER_NUM_RANGES, registers_read_settle_times, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_COMPUTED_VALUE_OFFSET,               1, 0, 4, registers_read_computed_value, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_FILTER_MEDIAN_LENGTH_OFFSET,         1, 0, 4, registers_read_filter_median_length, 0, registers_write_filter_median_length, REGISTER_WRITE_DEFERRED },
+    { EGG_BUS_SENSOR_BLOCK_FILTER_EWMA_SHIFT_OFFSET,            1, 0, 4, registers_read_filter_ewma_shift, 0, registers_write_filter_ewma_shift, REGISTER_WRITE_DEFERRED },
+    { EGG_BUS_SENSOR_BLOCK_FILTERED_VALUE_OFFSET,               1, 0, 4, registers_read_filtered_value, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_HISTORY_INTERVAL_OFFSET,             1, 0, 4, registers_read_history_interval, 0, registers_write_history_interval, REGISTER_WRITE_DEFERRED },
+    { EGG_BUS_SENSOR_BLOCK_HISTORY_INFO_OFFSET,                 1, 0, HISTORY_INFO_LENGTH, registers_read_history_info, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_HISTORY_ENTRIES_OFFSET,              HISTORY_MAX_DEPTH, 2, HISTORY_ENTRY_LENGTH, registers_read_history_entries, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_STATS_MIN_OFFSET,                    1, 0, 4, registers_read_stats_min, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_STATS_MAX_OFFSET,                    1, 0, 4, registers_read_stats_max, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_STATS_MEAN_OFFSET,                   1, 0, 4, registers_read_stats_mean, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_STATS_VARIANCE_OFFSET,               1, 0, 4, registers_read_stats_variance, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_STATS_COUNT_OFFSET,                  1, 0, 4, registers_read_stats_count, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_STATS_WINDOW_OFFSET,                 1, 0, 4, registers_read_stats_window, 0, registers_write_stats_window, REGISTER_WRITE_DEFERRED },
+    // reading it restarts the statistics window
+    { EGG_BUS_SENSOR_BLOCK_STATS_SNAPSHOT_OFFSET,               1, 0, 4 | FIELD_SPAN_NOT_STREAMED, registers_read_stats_snapshot, 0, 0 },
+    { EGG_BUS_SENSOR_BLOCK_ALARM_THRESHOLD_OFFSET,              1, 0, 4, registers_read_alarm_threshold, 0, registers_write_alarm_threshold },
+    { EGG_BUS_SENSOR_BLOCK_ALARM_CONFIG_OFFSET,                 1, 0, 4, registers_read_alarm_config, 0, registers_write_alarm_config },
+    { EGG_BUS_SENSOR_BLOCK_ALARM_STATUS_OFFSET,                 1, 0, 4, registers_read_alarm_status, 0, registers_write_alarm_status },
+    { EGG_BUS_SENSOR_BLOCK_HEATER_KP_OFFSET,                    1, 0, 4, registers_read_heater_kp, 0, registers_write_heater_kp, REGISTER_WRITE_DEFERRED },
+    { EGG_BUS_SENSOR_BLOCK_HEATER_KI_OFFSET,                    1, 0, 4, registers_read_heater_ki, 0, registers_write_heater_ki, REGISTER_WRITE_DEFERRED },
+};
+
+/* finds the field at this address and copies its descriptor out of flash,
+ * returns zero if there isn't one. both tables start at zero so there is always
+ * a last entry at or below the address to check it against */
+static uint8_t registers_find(uint16_t address, register_descriptor_t * descriptor, uint8_t * sensor_index, uint8_t * element){
+    const register_descriptor_t * table = registers_header_table;
+    uint8_t low = 0;
+    uint8_t high = REGISTERS_COUNT(registers_header_table);
+    uint8_t middle = 0;
+    uint16_t delta = 0;
+
+    *sensor_index = 0;
+    if(address >= EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS
+            && address < EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS + EGG_BUS_NUM_HOSTED_SENSORS * EGG_BUS_SENSOR_BLOCK_SIZE){
+        address -= EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS;
+        *sensor_index = address >> 8;
+        address &= 0xff;
+        table = registers_sensor_table;
+        high = REGISTERS_COUNT(registers_sensor_table);
+    }
+
+    // the last entry at or below the address
+    while(high - low > 1){
+        middle = (low + high) >> 1;
+        if(pgm_read_word(&table[middle].address) <= address){
+            low = middle;
+        }
+        else{
+            high = middle;
+        }
+    }
+
+    memcpy_P(descriptor, &table[low], sizeof(register_descriptor_t));
+
+    delta = address - descriptor->address;
+    if((delta & ((1 << descriptor->stride_shift) - 1)) != 0 || (delta >> descriptor->stride_shift) >= descriptor->count){
+        return 0;
+    }
+    *element = delta >> descriptor->stride_shift;
+
+    return 1;
+}
+
+/* points the source at the response for a read of the given address. live values are
+ * built in the response buffer, which has to stay put until they've gone out */
+void registers_get_source(uint16_t address, twi_source_t * source, uint8_t * response){
+    register_descriptor_t descriptor;
+    uint8_t sensor_index = 0;
+    uint8_t element = 0;
+
+    memset(response, 0, EGG_BUS_MAX_RESPONSE_LENGTH);
+    source->type = TWI_SOURCE_RAM;
+    source->length = 4; // zeros, unless there is something here
+    source->data = response;
+
+    if(!registers_find(address, &descriptor, &sensor_index, &element)){
+        return;
+    }
+
+    if(descriptor.source != 0){
+        descriptor.source(sensor_index, element, source);
+    }
+    else{
+        source->length = descriptor.read(sensor_index, element, response);
+    }
+}
+
+/* how many addresses the field at this address takes up in the register map, which is how far
+ * a streaming read moves on after it. zero if there is no field there, and fields whose reads
+ * have side effects are flagged so a stream passes over them */
+uint8_t registers_get_span(uint16_t address){
+    register_descriptor_t descriptor;
+    uint8_t sensor_index = 0;
+    uint8_t element = 0;
+
+    if(!registers_find(address, &descriptor, &sensor_index, &element)){
+        return 0;
+    }
+
+    return descriptor.span;
+}
+
+/* called from the TWI ISR, returns zero for writes to read only fields, to addresses with nothing
+ * there and when the command queue is full. slow writes are only queued, see registers_run_deferred */
+uint8_t registers_write(uint16_t address, uint32_t value){
+    register_descriptor_t descriptor;
+    uint8_t sensor_index = 0;
+    uint8_t element = 0;
+
+    if(!registers_find(address, &descriptor, &sensor_index, &element) || descriptor.write == 0){
+        return 0;
+    }
+
+    if(descriptor.flags & REGISTER_WRITE_DEFERRED){
+        return command_queue_push(address, value);
+    }
+
+    descriptor.write(sensor_index, element, value);
+    return 1;
+}
+
+// main loop only, does the writes that were queued up since the last call
+void registers_run_deferred(void){
+    register_descriptor_t descriptor;
+    uint8_t sensor_index = 0;
+    uint8_t element = 0;
+    command_t command;
+
+    while(command_queue_pop(&command)){
+        if(registers_find(command.address, &descriptor, &sensor_index, &element) && descriptor.write != 0){
+            descriptor.write(sensor_index, element, command.value);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * registers.h
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef REGISTERS_H_
+#define REGISTERS_H_
+
+#include <stdint.h>
+#include "egg_bus.h"
+#include "twi.h"
+
+// or'ed into a field span for fields that a streaming read has to pass over
+#define FIELD_SPAN_NOT_STREAMED    0x80
+
+// the write goes through the command queue and gets done in the main loop
+#define REGISTER_WRITE_DEFERRED    0x01
+
+// the sensor index and field offset come straight out of the two address bytes
+#if EGG_BUS_SENSOR_BLOCK_SIZE != 256
+#error "register lookup assumes 256 byte sensor blocks"
+#endif
+
+/* builds the response for a field, returns its length (at most EGG_BUS_MAX_RESPONSE_LENGTH)
+ * element is which one of a run of identical fields is being read, zero for a plain field */
+typedef uint8_t (*register_read_t)(uint8_t sensor_index, uint8_t element, uint8_t * response);
+// for fields that don't change, points the source at the bytes where they already are instead
+typedef void (*register_source_t)(uint8_t sensor_index, uint8_t element, twi_source_t * source);
+typedef void (*register_write_t)(uint8_t sensor_index, uint8_t element, uint32_t value);
+
+/* one field, or a run of count identical fields 2^stride_shift addresses apart, in the register map.
+ * the tables live in flash sorted by address and are binary searched, so a lookup
+ * takes the same handful of steps whatever the address */
+typedef struct{
+    uint16_t address;         // absolute in the header table, relative to the start of the block in the sensor table
+    uint8_t  count;           // 1 for a plain field
+    uint8_t  stride_shift;    // 0 for a plain field
+    uint8_t  span;            // how far a streaming read moves on after the field, with FIELD_SPAN_NOT_STREAMED if it has to pass over it
+    register_read_t read;     // live values are copied so they can't tear while they go out
+    register_source_t source; // used instead of read when set
+    register_write_t write;   // 0 for read only fields
+    uint8_t  flags;           // REGISTER_WRITE_DEFERRED for writes too slow for the TWI ISR
+} register_descriptor_t;
+
+void registers_get_source(uint16_t address, twi_source_t * source, uint8_t * response);
+uint8_t registers_get_span(uint16_t address);
+uint8_t registers_write(uint16_t address, uint32_t value);
+void registers_run_deferred(void);
+
+#endif /* REGISTERS_H_ */
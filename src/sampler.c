@@ -0,0 +1,387 @@
+/*
+ * sampler.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+#include "sampler.h"
+#include "egg_bus.h"
+#include "adc.h"
+#include "timer.h"
+#include "interpolation.h"
+#include "filter.h"
+#include "history.h"
+#include "stats.h"
+#include "alarm.h"
+#include "heater_control.h"
+#include "sensor_math.h"
+#include "utility.h"
+#include "profile.h"
+
+/* the measurements get done here, in the main loop, rather than in the TWI ISR
+ * so the only thing onRequestService has to do is copy the latest sample out */
+static sensor_sample_t sampler_samples[EGG_BUS_NUM_HOSTED_SENSORS];
+
+// 0 => plain average of NUM_ADC_READINGS_TO_AVERAGE readings at 10 bits
+// n => 4^n readings decimated to 10 + n bits
+static uint8_t sampler_oversampling[EGG_BUS_NUM_HOSTED_SENSORS] = {0, 0};
+
+// the divider configuration each sensor was last measured on, which is also what the hardware is left on
+static uint8_t sampler_range[EGG_BUS_NUM_HOSTED_SENSORS] = {SAMPLER_RANGE_UNKNOWN, SAMPLER_RANGE_UNKNOWN};
+
+// how long the last switch into each range took to settle, in SAMPLER_SETTLE_TIME_UNIT_US units
+// (a byte is enough for the timeout and a single reading takes longer than one unit)
+#define SAMPLER_SETTLE_TIME_UNIT_US 64
+static uint8_t sampler_settle_time[EGG_BUS_NUM_HOSTED_SENSORS][SAMPLER_NUM_RANGES];
+
+// the last snapshot frame, already packed so reading it is just a copy
+static uint8_t sampler_snapshot[SAMPLER_SNAPSHOT_LENGTH];
+static uint16_t sampler_snapshot_sequence = 0;
+
+static uint16_t sampler_measure(uint8_t sensor_index, uint8_t oversampling);
+static uint32_t sampler_compute_independent(uint8_t sensor_index, uint16_t adc_value, uint8_t oversampling, uint32_t low_side_resistance);
+
+uint32_t sampler_get_low_side_resistance(uint8_t sensor_index, uint8_t range_index){
+    uint32_t ret = get_r1(sensor_index);
+    if(range_index < 2){
+        ret += get_r2(sensor_index);
+    }
+    if(range_index < 1){
+        ret += get_r3(sensor_index);
+    }
+    return ret;
+}
+
+// watches the sensor channel after a divider switch until the readings stop moving
+static void sampler_wait_for_settle(uint8_t sensor_index, uint8_t range_index){
+    uint8_t channel_num = egg_bus_map_to_analog_pin(sensor_index);
+    uint32_t start_us = timer_micros();
+    uint32_t elapsed_us = 0;
+    uint32_t settle_time = 0;
+    uint16_t reference = analogRead(channel_num);
+    uint16_t reading = 0;
+    uint8_t stable_readings = 0;
+
+    while(stable_readings < SAMPLER_SETTLE_STABLE_READINGS){
+        elapsed_us = timer_micros() - start_us;
+        if(elapsed_us >= SAMPLER_SETTLE_TIMEOUT_US){
+            break;
+        }
+
+        reading = analogRead(channel_num);
+        if(reading + SAMPLER_SETTLE_BAND < reference || reading > reference + SAMPLER_SETTLE_BAND){
+            // still moving, start counting again from here
+            reference = reading;
+            stable_readings = 0;
+        }
+        else{
+            stable_readings++;
+        }
+    }
+
+    elapsed_us = timer_micros() - start_us;
+    settle_time = (elapsed_us + SAMPLER_SETTLE_TIME_UNIT_US / 2) / SAMPLER_SETTLE_TIME_UNIT_US;
+    sampler_settle_time[sensor_index][range_index] = settle_time > 0xff ? 0xff : (uint8_t) settle_time;
+}
+
+uint16_t sampler_get_settle_time_us(uint8_t sensor_index, uint8_t range_index){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS || range_index >= SAMPLER_NUM_RANGES){
+        return 0;
+    }
+    return sampler_settle_time[sensor_index][range_index] * SAMPLER_SETTLE_TIME_UNIT_US;
+}
+
+// switches the low side divider to the requested configuration and waits for it to settle
+static void sampler_select_range(uint8_t sensor_index, uint8_t range_index){
+    if(range_index == 0){
+        // R2 and R3 enabled
+        SENSOR_R2_ENABLE(sensor_index);
+        SENSOR_R3_ENABLE(sensor_index);
+    }
+    else if(range_index == 1){
+        // R3 disabled
+        SENSOR_R2_ENABLE(sensor_index);
+        SENSOR_R3_DISABLE(sensor_index);
+    }
+    else{
+        // R2 and R3 disabled
+        SENSOR_R2_DISABLE(sensor_index);
+        SENSOR_R3_DISABLE(sensor_index);
+    }
+    sampler_wait_for_settle(sensor_index, range_index);
+}
+
+// measures the sensor on all three low side divider configurations and picks the best one
+// this is only needed when we have no idea what range the sensor is in
+static uint8_t sampler_sweep_ranges(uint8_t sensor_index, uint8_t oversampling){
+    uint16_t possible_values[SAMPLER_NUM_RANGES] = {0,0,0};
+
+    for(uint8_t ii = 0; ii < SAMPLER_NUM_RANGES; ii++){
+        sampler_select_range(sensor_index, ii);
+        possible_values[ii] = sampler_measure(sensor_index, oversampling);
+    }
+
+    // figure out the "best value index" ... here's how this algorithm works:
+    // If the ADC reading when using the R1 + R2 + R3 chain is below THRESHOLD1 use that value
+    // else if the ADC reading when using the R1 + R2 chain is below THRESHOLD2 use that value
+    // else use the ADC reading using the R1 chain
+    // (the thresholds are in 10-bit ADC counts, so oversampled readings get scaled back down to compare)
+    if((possible_values[0] >> oversampling) < get_r1r2r3_threshold(sensor_index)){
+        return 0;
+    }
+    else if((possible_values[1] >> oversampling) < get_r1r2_threshold(sensor_index)){
+        return 1;
+    }
+    return 2;
+}
+
+/* maps an ADC threshold taken on one divider configuration onto the reading the same
+ * sensor resistance would give on another configuration, all in 10-bit ADC counts
+ *   full scale F = 1024 * SENSOR_VCC / ADC_VCC
+ *   at threshold T on R_FROM the sensor is R_SENSOR = R_FROM * (F - T) / T
+ *   so on R_TO it reads F * R_TO / (R_TO + R_SENSOR) = F * R_TO * T / (R_TO * T + R_FROM * (F - T)) */
+static uint16_t sampler_map_threshold(uint8_t sensor_index, uint16_t threshold, uint8_t from_range, uint8_t to_range){
+    uint32_t full_scale = (1024L * get_sensor_vcc(sensor_index)) / ADC_VCC_TENTH_VOLTS;
+    uint32_t numerator = 0;
+    uint32_t denominator = 0;
+
+    if(threshold >= full_scale){
+        return full_scale;
+    }
+
+    numerator = sampler_get_low_side_resistance(sensor_index, to_range) * threshold;
+    denominator = numerator + sampler_get_low_side_resistance(sensor_index, from_range) * (full_scale - threshold);
+
+    // both terms are far bigger than 2^10, so dropping the low bits keeps the product in range
+    return (uint16_t) ((full_scale * (numerator >> 10)) / (denominator >> 10));
+}
+
+/* decides which range the sensor should be measured on next, given a 10-bit reading on the current one
+ * it steps up a range once the reading is past the threshold of the current range by more than the hysteresis,
+ * and steps down once the reading on the lower range would be back under that range's threshold by more than the hysteresis */
+static uint8_t sampler_track_range(uint8_t sensor_index, uint8_t range_index, uint16_t adc_value){
+    uint16_t step_down_threshold = 0;
+
+    if(range_index == 0 && adc_value >= get_r1r2r3_threshold(sensor_index) + SAMPLER_RANGE_HYSTERESIS){
+        return 1;
+    }
+    else if(range_index == 1 && adc_value >= get_r1r2_threshold(sensor_index) + SAMPLER_RANGE_HYSTERESIS){
+        return 2;
+    }
+
+    if(range_index == 1){
+        step_down_threshold = sampler_map_threshold(sensor_index, get_r1r2r3_threshold(sensor_index), 0, 1);
+    }
+    else if(range_index == 2){
+        step_down_threshold = sampler_map_threshold(sensor_index, get_r1r2_threshold(sensor_index), 1, 2);
+    }
+
+    if(range_index > 0 && adc_value + SAMPLER_RANGE_HYSTERESIS < step_down_threshold){
+        return range_index - 1;
+    }
+
+    return range_index;
+}
+
+// measures the sensor and publishes the result, this blocks for tens of milliseconds so never call it from an ISR
+// in steady state only the range the sensor was in last time gets measured
+void sampler_update(uint8_t sensor_index){
+    uint16_t adc_value = 0;
+    uint8_t range_index = 0;
+    uint8_t next_range_index = 0;
+    uint32_t independent_value = 0;
+    uint32_t filtered_value = 0;
+    uint32_t computed_value = 0;
+    uint8_t oversampling = 0;
+
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    oversampling = sampler_oversampling[sensor_index];
+    range_index = sampler_range[sensor_index];
+
+    if(range_index == SAMPLER_RANGE_UNKNOWN){
+        range_index = sampler_sweep_ranges(sensor_index, oversampling);
+        sampler_select_range(sensor_index, range_index);
+    }
+
+    // the divider is already on range_index, measure and move to a neighbouring range if need be
+    // (at most SAMPLER_NUM_RANGES measurements, so a fast moving signal can't keep us here forever)
+    for(uint8_t ii = 0; ; ii++){
+        adc_value = sampler_measure(sensor_index, oversampling);
+        next_range_index = sampler_track_range(sensor_index, range_index, adc_value >> oversampling);
+        if(next_range_index == range_index || ii >= SAMPLER_NUM_RANGES - 1){
+            break;
+        }
+        range_index = next_range_index;
+        sampler_select_range(sensor_index, range_index);
+    }
+    sampler_range[sensor_index] = range_index;
+
+    independent_value = sampler_compute_independent(sensor_index, adc_value, oversampling,
+            sampler_get_low_side_resistance(sensor_index, range_index));
+    filtered_value = filter_update(sensor_index, independent_value);
+    computed_value = interpolation_compute_ppb(sensor_index, filtered_value);
+
+    // publish the new sample in one go so the TWI ISR never sees half of an update
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        sampler_samples[sensor_index].independent_value = independent_value;
+        sampler_samples[sensor_index].computed_value = computed_value;
+        sampler_samples[sensor_index].adc_value = adc_value;
+        sampler_samples[sensor_index].adc_bits = 10 + oversampling;
+        sampler_samples[sensor_index].range_index = range_index;
+        sampler_samples[sensor_index].timestamp_ms = timer_millis();
+        sampler_samples[sensor_index].valid = 1;
+    }
+
+    history_record(sensor_index, computed_value);
+    stats_update(sensor_index, computed_value);
+    alarm_on_sample(sensor_index, computed_value);
+}
+
+// safe to call from the TWI ISR as well as from the main loop
+void sampler_get_sample(uint8_t sensor_index, sensor_sample_t * sample){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        memset(sample, 0, sizeof(sensor_sample_t));
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        memcpy(sample, &(sampler_samples[sensor_index]), sizeof(sensor_sample_t));
+    }
+}
+
+// returns the number of milliseconds since the sensor was last measured
+uint32_t sampler_get_age_ms(uint8_t sensor_index){
+    sensor_sample_t sample;
+    sampler_get_sample(sensor_index, &sample);
+    if(!sample.valid){
+        return SAMPLER_AGE_NEVER_SAMPLED;
+    }
+    return timer_millis() - sample.timestamp_ms;
+}
+
+/* packs the latest sample of every sensor together with its heater power into one frame,
+ * the main loop calls this once every sensor has been updated so all of them come from the same pass.
+ * the heaters get measured here too rather than taken from the heater task's last update, which can be seconds old */
+void sampler_capture_snapshot(void){
+    uint8_t frame[SAMPLER_SNAPSHOT_LENGTH];
+    uint8_t * p = frame + SAMPLER_SNAPSHOT_HEADER_LENGTH;
+    sensor_sample_t sample;
+    uint32_t heater_power_mw = 0;
+    uint32_t target_power_mw = 0;
+    uint8_t status = 0;
+
+    frame[0] = SAMPLER_SNAPSHOT_VERSION;
+    frame[1] = EGG_BUS_NUM_HOSTED_SENSORS;
+
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        sampler_get_sample(ii, &sample);
+        heater_control_measure(ii);
+        heater_power_mw = heater_control_get_heater_power_mw(ii);
+        target_power_mw = heater_control_get_target_power_mw(ii);
+
+        status = sample.range_index & SAMPLER_SNAPSHOT_RANGE_MASK;
+        if(!sample.valid){
+            status |= SAMPLER_FAULT_NOT_SAMPLED;
+        }
+        else if(sample.independent_value == SENSOR_MATH_INFINITY){
+            status |= SAMPLER_FAULT_OPEN_CIRCUIT;
+        }
+        else if(sample.independent_value == 0){
+            status |= SAMPLER_FAULT_SHORT_CIRCUIT;
+        }
+        if(2 * heater_power_mw < target_power_mw || heater_power_mw > 2 * target_power_mw){
+            status |= SAMPLER_FAULT_HEATER;
+        }
+
+        big_endian_copy_uint16_to_buffer(sample.computed_value > 0xffff ? 0xffff : (uint16_t) sample.computed_value, p);
+        big_endian_copy_uint16_to_buffer(sample.adc_value, p + 2);
+        p[4] = status;
+        big_endian_copy_uint16_to_buffer(heater_power_mw > 0xffff ? 0xffff : (uint16_t) heater_power_mw, p + 5);
+        p += SAMPLER_SNAPSHOT_SENSOR_LENGTH;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        sampler_snapshot_sequence++;
+        big_endian_copy_uint16_to_buffer(sampler_snapshot_sequence, frame + 2);
+        memcpy(sampler_snapshot, frame, SAMPLER_SNAPSHOT_LENGTH);
+    }
+}
+
+// fills SAMPLER_SNAPSHOT_LENGTH bytes, safe to call from the TWI ISR
+void sampler_copy_snapshot(uint8_t * buffer){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        memcpy(buffer, sampler_snapshot, SAMPLER_SNAPSHOT_LENGTH);
+    }
+}
+
+void sampler_set_oversampling(uint8_t sensor_index, uint8_t oversampling){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    if(oversampling > SAMPLER_MAX_OVERSAMPLING){
+        oversampling = SAMPLER_MAX_OVERSAMPLING;
+    }
+    sampler_oversampling[sensor_index] = oversampling;
+}
+
+uint8_t sampler_get_oversampling(uint8_t sensor_index){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return 0;
+    }
+    return sampler_oversampling[sensor_index];
+}
+
+static uint16_t sampler_measure(uint8_t sensor_index, uint8_t oversampling){
+    if(oversampling == 0){
+        return averageADC(sensor_index);
+    }
+    return oversampleADC(sensor_index, oversampling);
+}
+
+static uint32_t sampler_compute_independent(uint8_t sensor_index, uint16_t adc_value, uint8_t oversampling, uint32_t low_side_resistance){
+    uint32_t resistance = sensor_math_resistance(adc_value, 10 + oversampling, low_side_resistance,
+            get_sensor_vcc(sensor_index), ADC_VCC_TENTH_VOLTS);
+
+    // the independent variable is R_Sensed / R0
+    return sensor_math_independent(resistance, get_independent_scaler_inverse(sensor_index), egg_bus_get_r0_ohms(sensor_index));
+}
+
+#define NUM_ADC_READINGS_TO_AVERAGE 100L
+#define NUM_ADC_READINGS_TO_AVERAGE_NOISE_REDUCTION 16L // the quieter conversions need far fewer samples
+uint16_t averageADC(uint8_t sensor_index){
+    uint16_t profile_start_count = profile_start();
+    uint32_t ret = 0;
+    uint8_t num_readings = NUM_ADC_READINGS_TO_AVERAGE;
+    if(adc_get_conversion_mode() == ADC_CONVERSION_NOISE_REDUCTION){
+        num_readings = NUM_ADC_READINGS_TO_AVERAGE_NOISE_REDUCTION;
+    }
+
+    for(uint8_t ii = 0; ii < num_readings; ii++){
+        ret += analogRead(egg_bus_map_to_analog_pin(sensor_index));
+    }
+    ret /= num_readings;
+
+    profile_stop(PROFILE_AVERAGE_ADC, profile_start_count);
+    return (uint16_t) ret;
+}
+
+// oversampling and decimation, per Atmel App Note AVR121
+// sums 4^n readings and shifts the sum right by n for a result with 10 + n bits
+// (this only buys resolution because there is at least an LSB of noise on the sensor signal)
+uint16_t oversampleADC(uint8_t sensor_index, uint8_t oversampling){
+    uint32_t ret = 0;
+    uint16_t num_readings = 1 << (2 * oversampling);
+    for(uint16_t ii = 0; ii < num_readings; ii++){
+        ret += analogRead(egg_bus_map_to_analog_pin(sensor_index));
+    }
+
+    return (uint16_t) (ret >> oversampling);
+}
@@ -0,0 +1,80 @@
+/*
+ * sampler.h
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+#include <stdint.h>
+#include "egg_bus.h"
+
+#define SAMPLER_NUM_RANGES          3
+#define SAMPLER_RANGE_UNKNOWN       0xff
+#define SAMPLER_RANGE_HYSTERESIS    8   // ADC counts (10-bit) either side of a divider switchover threshold
+
+// after switching the divider a sensor counts as settled once this many successive
+// readings stay within the band around the first of them, or when the timeout runs out
+#ifndef SAMPLER_SETTLE_BAND
+#define SAMPLER_SETTLE_BAND             2     // ADC counts
+#endif
+#ifndef SAMPLER_SETTLE_STABLE_READINGS
+#define SAMPLER_SETTLE_STABLE_READINGS  8
+#endif
+#ifndef SAMPLER_SETTLE_TIMEOUT_US
+#define SAMPLER_SETTLE_TIMEOUT_US       10000L // the fixed delay that used to be paid every time
+#endif
+#define SAMPLER_AGE_NEVER_SAMPLED   0xffffffff
+#define SAMPLER_MAX_OVERSAMPLING    6  // 4096 readings for a 16-bit result
+
+/* snapshot frame, everything big endian
+ *   0      version
+ *   1      number of sensors
+ *   2..3   sequence number, goes up by one with every capture
+ * then 7 bytes per sensor
+ *   0..1   computed value (saturated to 16 bits)
+ *   2..3   raw ADC value
+ *   4      range index in the low two bits, fault flags above that
+ *   5..6   heater power in mW (saturated to 16 bits)
+ * the heater power is measured when the frame is captured, right after the sensors,
+ * from the ADC task's last ADC_RING_DEPTH passes over the heater channels */
+#define SAMPLER_SNAPSHOT_VERSION        2
+#define SAMPLER_SNAPSHOT_HEADER_LENGTH  4
+#define SAMPLER_SNAPSHOT_SENSOR_LENGTH  7
+#define SAMPLER_SNAPSHOT_LENGTH         (SAMPLER_SNAPSHOT_HEADER_LENGTH + SAMPLER_SNAPSHOT_SENSOR_LENGTH * EGG_BUS_NUM_HOSTED_SENSORS)
+#if SAMPLER_SNAPSHOT_LENGTH > EGG_BUS_MAX_RESPONSE_LENGTH
+#error "the snapshot frame has to fit in a single response"
+#endif
+#define SAMPLER_SNAPSHOT_RANGE_MASK     0x03
+#define SAMPLER_FAULT_NOT_SAMPLED       0x04  // no measurement yet
+#define SAMPLER_FAULT_OPEN_CIRCUIT      0x08  // sensor resistance reads as infinite
+#define SAMPLER_FAULT_SHORT_CIRCUIT     0x10  // sensor resistance reads as zero
+#define SAMPLER_FAULT_HEATER            0x20  // heater power is under half or over twice its target
+
+/* the most recent measurement for a sensor, published by the main loop
+ * and served to the TWI master from here without touching the ADC */
+typedef struct{
+    uint32_t independent_value;  // R_SENSOR / R0, scaled by the independent scaler inverse
+    uint32_t computed_value;     // the filter output (filter_get_output) run through the interpolation table, in the sensor's units
+    uint32_t timestamp_ms;       // timer_millis() at the time the sample was published
+    uint16_t adc_value;          // ADC reading on the chosen low side divider
+    uint8_t  adc_bits;           // effective resolution of adc_value
+    uint8_t  range_index;        // 0 => R1 + R2 + R3, 1 => R1 + R2, 2 => R1
+    uint8_t  valid;              // zero until the first measurement completes
+} sensor_sample_t;
+
+void sampler_update(uint8_t sensor_index);
+void sampler_get_sample(uint8_t sensor_index, sensor_sample_t * sample);
+uint32_t sampler_get_age_ms(uint8_t sensor_index);
+uint32_t sampler_get_low_side_resistance(uint8_t sensor_index, uint8_t range_index);
+uint16_t sampler_get_settle_time_us(uint8_t sensor_index, uint8_t range_index);
+void sampler_set_oversampling(uint8_t sensor_index, uint8_t oversampling);
+uint8_t sampler_get_oversampling(uint8_t sensor_index);
+void sampler_capture_snapshot(void);
+void sampler_copy_snapshot(uint8_t * buffer);
+
+uint16_t averageADC(uint8_t sensor_index);
+uint16_t oversampleADC(uint8_t sensor_index, uint8_t oversampling);
+
+#endif /* SAMPLER_H_ */
@@ -0,0 +1,154 @@
+/*
+ * scheduler.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+#include "scheduler.h"
+#include "timer.h"
+
+/* a cooperative scheduler on the Timer0 millisecond tick. every task runs to completion,
+ * and when none of them is due the CPU sleeps in idle until the next interrupt,
+ * which is the tick at the latest. only the main loop calls into here, apart from
+ * the getters which the TWI ISR uses for the registers */
+
+static const scheduler_task_t * scheduler_tasks = 0; // in flash, SCHEDULER_NUM_TASKS of them
+static uint16_t scheduler_periods[SCHEDULER_NUM_TASKS] = {
+        SCHEDULER_HEATER_PERIOD_MS,
+        SCHEDULER_SAMPLER_PERIOD_MS,
+        SCHEDULER_DEFERRED_PERIOD_MS,
+        SCHEDULER_LED_PERIOD_MS,
+        SCHEDULER_ADC_PERIOD_MS
+};
+static uint16_t scheduler_last_run[SCHEDULER_NUM_TASKS]; // low 16 bits of timer_millis
+
+// idle time in the current window, the share of the last whole window and the total since start up
+static uint32_t scheduler_idle_us = 0;
+static uint16_t scheduler_window_start = 0;
+static uint16_t scheduler_idle_permille = 0;
+static uint32_t scheduler_idle_ms = 0;
+
+volatile uint8_t scheduler_wake_source = SCHEDULER_WAKE_NONE;
+static uint32_t scheduler_wake_counts[SCHEDULER_NUM_WAKE_SOURCES];
+
+// tasks is a table of SCHEDULER_NUM_TASKS functions in flash, indexed by SCHEDULER_TASK_*
+void scheduler_init(const scheduler_task_t * tasks){
+    uint16_t now = (uint16_t) timer_millis();
+
+    scheduler_tasks = tasks;
+    scheduler_window_start = now;
+
+    // everything is due on the first pass
+    for(uint8_t ii = 0; ii < SCHEDULER_NUM_TASKS; ii++){
+        scheduler_last_run[ii] = now - scheduler_periods[ii];
+    }
+}
+
+/* sleeps until the next interrupt and counts the time it spent asleep, and what woke it up.
+ * idle is as deep as it can go: the ATtiny48 has no asynchronous timer, and the tick runs off
+ * the I/O clock which every deeper mode stops. TWI address match would wake it from any of them */
+static void scheduler_idle(void){
+    uint32_t start_us = timer_micros();
+    uint8_t source = 0;
+
+    scheduler_wake_source = SCHEDULER_WAKE_NONE;
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sleep_cpu();
+    sleep_disable();
+
+    // the ISR of whatever woke us up has run by the time we get here
+    source = scheduler_wake_source;
+    if(source >= SCHEDULER_NUM_WAKE_SOURCES){
+        source = SCHEDULER_WAKE_OTHER;
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        scheduler_wake_counts[source]++;
+    }
+
+    scheduler_idle_us += timer_micros() - start_us;
+}
+
+static void scheduler_account_idle(void){
+    uint16_t elapsed_ms = (uint16_t) timer_millis() - scheduler_window_start;
+    uint16_t permille = 0;
+
+    if(elapsed_ms < SCHEDULER_IDLE_WINDOW_MS){
+        return;
+    }
+
+    // microseconds idle per millisecond is parts per thousand
+    permille = scheduler_idle_us / elapsed_ms > 1000 ? 1000 : (uint16_t) (scheduler_idle_us / elapsed_ms);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        scheduler_idle_permille = permille;
+        scheduler_idle_ms += scheduler_idle_us / 1000;
+    }
+
+    // the part of a millisecond left over goes into the next window
+    scheduler_idle_us %= 1000;
+    scheduler_window_start += elapsed_ms;
+}
+
+void scheduler_run(void){
+    uint16_t now = 0;
+    uint8_t ran = 0;
+
+    for(;;){
+        ran = 0;
+        for(uint8_t ii = 0; ii < SCHEDULER_NUM_TASKS; ii++){
+            now = (uint16_t) timer_millis();
+            if((uint16_t) (now - scheduler_last_run[ii]) >= scheduler_periods[ii]){
+                // keep to the period rather than drifting by however late the task got its turn,
+                // unless it is so late that it would have to catch up
+                scheduler_last_run[ii] += scheduler_periods[ii];
+                if((uint16_t) (now - scheduler_last_run[ii]) >= scheduler_periods[ii]){
+                    scheduler_last_run[ii] = now;
+                }
+                ((scheduler_task_t) pgm_read_word(&scheduler_tasks[ii]))();
+                ran = 1;
+            }
+        }
+
+        scheduler_account_idle();
+
+        // nothing was due, so nothing will be until an interrupt comes in
+        if(!ran){
+            scheduler_idle();
+        }
+    }
+}
+
+uint16_t scheduler_get_period(uint8_t task_index){
+    return scheduler_periods[task_index];
+}
+
+// main loop only, the new period counts from the last time the task ran
+void scheduler_set_period(uint8_t task_index, uint16_t period_ms){
+    if(task_index >= SCHEDULER_NUM_TASKS){
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        scheduler_periods[task_index] = period_ms > SCHEDULER_MAX_PERIOD_MS ? SCHEDULER_MAX_PERIOD_MS : period_ms;
+    }
+}
+
+// share of the last SCHEDULER_IDLE_WINDOW_MS spent asleep waiting for a task to come due, in parts per thousand
+uint16_t scheduler_get_idle_permille(void){
+    return scheduler_idle_permille;
+}
+
+// milliseconds spent asleep since start up
+uint32_t scheduler_get_idle_ms(void){
+    return scheduler_idle_ms;
+}
+
+// how many times since start up the CPU was woken out of its idle sleep by this SCHEDULER_WAKE_*
+uint32_t scheduler_get_wake_count(uint8_t source){
+    return source < SCHEDULER_NUM_WAKE_SOURCES ? scheduler_wake_counts[source] : 0;
+}
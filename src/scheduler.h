@@ -0,0 +1,70 @@
+/*
+ * scheduler.h
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+
+// the tasks main runs, in the order they get a turn when several are due
+#define SCHEDULER_TASK_HEATER      0 // heater power control
+#define SCHEDULER_TASK_SAMPLER     1 // measure, filter and publish both sensors
+#define SCHEDULER_TASK_DEFERRED    2 // register writes queued by the TWI ISR, EEPROM commits among them
+#define SCHEDULER_TASK_LED         3 // status LED heartbeat
+#define SCHEDULER_TASK_ADC         4 // one conversion of every channel in the ADC sequence
+#define SCHEDULER_NUM_TASKS        5
+
+// default periods in milliseconds, a period of zero runs the task on every pass
+#ifndef SCHEDULER_HEATER_PERIOD_MS
+#define SCHEDULER_HEATER_PERIOD_MS   3000 // give the heater time to settle in between changes
+#endif
+#ifndef SCHEDULER_SAMPLER_PERIOD_MS
+#define SCHEDULER_SAMPLER_PERIOD_MS  250
+#endif
+#ifndef SCHEDULER_DEFERRED_PERIOD_MS
+#define SCHEDULER_DEFERRED_PERIOD_MS 20
+#endif
+#ifndef SCHEDULER_LED_PERIOD_MS
+#define SCHEDULER_LED_PERIOD_MS      1000
+#endif
+#ifndef SCHEDULER_ADC_PERIOD_MS
+#define SCHEDULER_ADC_PERIOD_MS      100  // 60 background conversions a second with the six channels main.c converts
+#endif
+
+// last run times are kept as 16 bits of timer_millis, so periods have to stay well short of that
+#define SCHEDULER_MAX_PERIOD_MS      60000
+
+// the idle share gets worked out over this many milliseconds
+#ifndef SCHEDULER_IDLE_WINDOW_MS
+#define SCHEDULER_IDLE_WINDOW_MS     1000
+#endif
+
+// what woke the CPU up out of its idle sleep, the first interrupt to come in after it went to sleep
+#define SCHEDULER_WAKE_TICK        0 // the Timer0 millisecond tick
+#define SCHEDULER_WAKE_TWI         1 // TWI, address match or anything after it
+#define SCHEDULER_WAKE_ADC         2 // a conversion finished
+#define SCHEDULER_WAKE_OTHER       3
+#define SCHEDULER_NUM_WAKE_SOURCES 4
+#define SCHEDULER_WAKE_NONE        0xff
+
+extern volatile uint8_t scheduler_wake_source;
+
+// for the ISRs that can wake the CPU, only the first one in after a sleep gets the credit
+#define SCHEDULER_NOTE_WAKE(source) do{ \
+        if(scheduler_wake_source == SCHEDULER_WAKE_NONE) scheduler_wake_source = (source); \
+    }while(0)
+
+typedef void (*scheduler_task_t)(void);
+
+void scheduler_init(const scheduler_task_t * tasks);
+void scheduler_run(void) __attribute__((noreturn));
+uint16_t scheduler_get_period(uint8_t task_index);
+void scheduler_set_period(uint8_t task_index, uint16_t period_ms);
+uint16_t scheduler_get_idle_permille(void);
+uint32_t scheduler_get_idle_ms(void);
+uint32_t scheduler_get_wake_count(uint8_t source);
+
+#endif /* SCHEDULER_H_ */
@@ -0,0 +1,103 @@
+/*
+ * sensor_math.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <stdint.h>
+#include "sensor_math.h"
+
+/* the sensor calculations all boil down to a * b / c with 32-bit operands,
+ * so rather than juggling the order of 32-bit multiplies and divides to dodge overflow
+ * (and losing precision when we guess wrong) we form the exact 64-bit product and do
+ * a single 64 by 32 bit division. Both are written out by hand so that libgcc's general
+ * 64-bit routines don't get pulled in. */
+
+// full 64-bit product of two 32-bit values out of four 16 x 16 bit partial products
+void sensor_math_mul32(uint32_t a, uint32_t b, uint32_t * product_high, uint32_t * product_low){
+    uint16_t a_low  = (uint16_t) a;
+    uint16_t a_high = (uint16_t) (a >> 16);
+    uint16_t b_low  = (uint16_t) b;
+    uint16_t b_high = (uint16_t) (b >> 16);
+
+    uint32_t low_low   = (uint32_t) a_low  * b_low;
+    uint32_t low_high  = (uint32_t) a_low  * b_high;
+    uint32_t high_low  = (uint32_t) a_high * b_low;
+    uint32_t high_high = (uint32_t) a_high * b_high;
+
+    // the middle column can carry at most two bits, so it fits in 32
+    uint32_t middle = (low_low >> 16) + (low_high & 0xffff) + (high_low & 0xffff);
+
+    *product_low  = (low_low & 0xffff) | (middle << 16);
+    *product_high = high_high + (low_high >> 16) + (high_low >> 16) + (middle >> 16);
+}
+
+// floor((dividend_high:dividend_low) / divisor)
+// returns SENSOR_MATH_INFINITY if the quotient does not fit in 32 bits or the divisor is zero
+uint32_t sensor_math_div64(uint32_t dividend_high, uint32_t dividend_low, uint32_t divisor){
+    uint32_t remainder = dividend_high;
+    uint32_t quotient = 0;
+    uint8_t carry = 0;
+
+    if(divisor == 0 || dividend_high >= divisor){
+        return SENSOR_MATH_INFINITY;
+    }
+
+    // restoring shift-and-subtract division, the remainder is always less than the divisor
+    // going in so one bit of carry out of the shift is all we need to keep track of
+    for(uint8_t ii = 0; ii < 32; ii++){
+        carry = (uint8_t) (remainder >> 31);
+        remainder = (remainder << 1) | (dividend_low >> 31);
+        dividend_low <<= 1;
+        quotient <<= 1;
+        if(carry || remainder >= divisor){
+            remainder -= divisor;
+            quotient |= 1;
+        }
+    }
+
+    return quotient;
+}
+
+// floor(a * b / c) without overflow, saturates at SENSOR_MATH_INFINITY
+uint32_t sensor_math_muldiv(uint32_t a, uint32_t b, uint32_t c){
+    uint32_t product_high = 0;
+    uint32_t product_low = 0;
+    sensor_math_mul32(a, b, &product_high, &product_low);
+    return sensor_math_div64(product_high, product_low, c);
+}
+
+/* the sensor sits on the high side of a divider with R_LOW_SIDE to ground
+ *   R_SENSOR = R_LOW_SIDE * SENSOR_VCC * (b - a) / (ADC_VCC * SENSOR_VCC * ADC)
+ *   where a = ADC_VCC * ADC and b = ADC_FULL_SCALE * SENSOR_VCC
+ * the SENSOR_VCC terms cancel, leaving R_LOW_SIDE * (b - a) / a = floor(R_LOW_SIDE * b / a) - R_LOW_SIDE exactly
+ * a reading of zero is an open circuit (infinity), a reading above full scale a short (zero) */
+uint32_t sensor_math_resistance(uint16_t adc_value, uint8_t adc_bits, uint32_t low_side_resistance,
+        uint8_t sensor_vcc_tenth_volts, uint8_t adc_vcc_tenth_volts){
+    uint32_t a = ((uint32_t) adc_value) * adc_vcc_tenth_volts;
+    uint32_t b = (1UL << adc_bits) * sensor_vcc_tenth_volts;
+    uint32_t ret = 0;
+
+    if(adc_value == 0){
+        return SENSOR_MATH_INFINITY;
+    }
+
+    if(a >= b){
+        return 0;
+    }
+
+    ret = sensor_math_muldiv(low_side_resistance, b, a);
+    if(ret == SENSOR_MATH_INFINITY){
+        return SENSOR_MATH_INFINITY;
+    }
+
+    return ret - low_side_resistance;
+}
+
+// the independent variable is R_SENSOR / R0, scaled up by the independent scaler inverse
+uint32_t sensor_math_independent(uint32_t resistance, uint32_t scaler_inverse, uint32_t r0){
+    if(resistance == SENSOR_MATH_INFINITY){
+        return SENSOR_MATH_INFINITY;
+    }
+    return sensor_math_muldiv(resistance, scaler_inverse, r0);
+}
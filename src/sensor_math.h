@@ -0,0 +1,21 @@
+/*
+ * sensor_math.h
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef SENSOR_MATH_H_
+#define SENSOR_MATH_H_
+
+#include <stdint.h>
+
+#define SENSOR_MATH_INFINITY 0xffffffff
+
+uint32_t sensor_math_muldiv(uint32_t a, uint32_t b, uint32_t c);
+uint32_t sensor_math_div64(uint32_t dividend_high, uint32_t dividend_low, uint32_t divisor);
+void sensor_math_mul32(uint32_t a, uint32_t b, uint32_t * product_high, uint32_t * product_low);
+uint32_t sensor_math_resistance(uint16_t adc_value, uint8_t adc_bits, uint32_t low_side_resistance,
+        uint8_t sensor_vcc_tenth_volts, uint8_t adc_vcc_tenth_volts);
+uint32_t sensor_math_independent(uint32_t resistance, uint32_t scaler_inverse, uint32_t r0);
+
+#endif /* SENSOR_MATH_H_ */
@@ -0,0 +1,166 @@
+/*
+ * stats.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <util/atomic.h>
+#include "stats.h"
+#include "egg_bus.h"
+#include "sensor_math.h"
+#include "utility.h"
+
+/* running min, max, mean and variance of each sensor's computed value, updated a sample at a time
+ * with Welford's method so nothing but the accumulators has to be kept around
+ *   mean_n = mean_n-1 + (x - mean_n-1) / n
+ *   M2_n   = M2_n-1 + (x - mean_n-1) * (x - mean_n)
+ *   variance = M2 / n
+ * mean is Q8 and M2 is Q16 held in 64 bits, which can't overflow for 16-bit inputs before count does */
+typedef struct{
+    uint32_t mean_q8;
+    uint32_t m2_high;
+    uint32_t m2_low;
+    uint16_t count;
+    uint16_t min;
+    uint16_t max;
+} stats_t;
+
+static stats_t stats[EGG_BUS_NUM_HOSTED_SENSORS];
+
+// samples per window, 0 keeps going until the master resets the window by reading the snapshot
+static uint16_t stats_window[EGG_BUS_NUM_HOSTED_SENSORS];
+
+// bumped by every reset from the TWI ISR, so an update that was in flight at the time gets dropped
+static volatile uint8_t stats_generation[EGG_BUS_NUM_HOSTED_SENSORS];
+
+// called by the sampler with every new computed value, main loop only
+void stats_update(uint8_t sensor_index, uint32_t value){
+    stats_t s;
+    uint8_t generation = 0;
+    uint16_t window = 0;
+    uint16_t x = 0;
+    int32_t delta = 0;
+    int32_t delta_after = 0;
+    uint32_t product_high = 0;
+    uint32_t product_low = 0;
+
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    x = value > 0xffff ? 0xffff : (uint16_t) value;
+
+    // work on a copy so the TWI ISR isn't held off during the arithmetic
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        memcpy(&s, &(stats[sensor_index]), sizeof(stats_t));
+        generation = stats_generation[sensor_index];
+        window = stats_window[sensor_index];
+    }
+
+    // a full window starts over with this sample, an open ended one once the count runs out
+    if(s.count >= (window != 0 ? window : 0xffff)){
+        s.count = 0;
+    }
+
+    if(s.count == 0){
+        s.count = 1;
+        s.min = x;
+        s.max = x;
+        s.mean_q8 = ((uint32_t) x) << 8;
+        s.m2_high = 0;
+        s.m2_low = 0;
+    }
+    else{
+        s.count++;
+        if(x < s.min){
+            s.min = x;
+        }
+        if(x > s.max){
+            s.max = x;
+        }
+
+        delta = (int32_t) (((uint32_t) x) << 8) - (int32_t) s.mean_q8;
+        s.mean_q8 += delta / (int32_t) s.count;
+        delta_after = (int32_t) (((uint32_t) x) << 8) - (int32_t) s.mean_q8;
+
+        // both deltas have the same sign, so the product is never negative
+        sensor_math_mul32(delta < 0 ? -delta : delta, delta_after < 0 ? -delta_after : delta_after,
+                &product_high, &product_low);
+        s.m2_low += product_low;
+        s.m2_high += product_high + (s.m2_low < product_low ? 1 : 0);
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        if(generation == stats_generation[sensor_index]){
+            memcpy(&(stats[sensor_index]), &s, sizeof(stats_t));
+        }
+    }
+}
+
+/* safe to call from the TWI ISR, with reset set the window starts over
+ * in the same step so no sample is counted twice or lost between two reads */
+void stats_get_summary(uint8_t sensor_index, stats_summary_t * summary, uint8_t reset){
+    stats_t s;
+
+    memset(summary, 0, sizeof(stats_summary_t));
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        memcpy(&s, &(stats[sensor_index]), sizeof(stats_t));
+        if(reset){
+            stats[sensor_index].count = 0;
+            stats_generation[sensor_index]++;
+        }
+    }
+
+    if(s.count == 0){
+        return;
+    }
+
+    summary->count = s.count;
+    summary->min = s.min;
+    summary->max = s.max;
+    summary->mean_q8 = s.mean_q8;
+    // M2 / n, taking M2 from Q16 down to Q8 first
+    summary->variance_q8 = sensor_math_div64(s.m2_high >> 8, (s.m2_high << 24) | (s.m2_low >> 8), s.count);
+}
+
+// fills STATS_SNAPSHOT_LENGTH bytes with the whole summary and starts a new window
+void stats_copy_snapshot(uint8_t sensor_index, uint8_t * buffer){
+    stats_summary_t summary;
+    stats_get_summary(sensor_index, &summary, 1);
+
+    big_endian_copy_uint16_to_buffer(summary.min, buffer);
+    big_endian_copy_uint16_to_buffer(summary.max, buffer + 2);
+    big_endian_copy_uint32_to_buffer((uint32_t) summary.count, buffer + 4);
+    big_endian_copy_uint32_to_buffer(summary.mean_q8, buffer + 8);
+    big_endian_copy_uint32_to_buffer(summary.variance_q8, buffer + 12);
+}
+
+void stats_set_window(uint8_t sensor_index, uint16_t window){
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        stats_window[sensor_index] = window;
+        stats[sensor_index].count = 0;
+        stats_generation[sensor_index]++;
+    }
+}
+
+uint16_t stats_get_window(uint8_t sensor_index){
+    uint16_t ret = 0;
+    if(sensor_index >= EGG_BUS_NUM_HOSTED_SENSORS){
+        return 0;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        ret = stats_window[sensor_index];
+    }
+    return ret;
+}
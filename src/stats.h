@@ -0,0 +1,30 @@
+/*
+ * stats.h
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+
+#define STATS_SNAPSHOT_LENGTH   16  // min (2 bytes), max (2 bytes), count, mean, variance, all big endian
+
+/* the statistics of the computed values in the current window,
+ * the mean and variance are fixed point with 8 fractional bits */
+typedef struct{
+    uint32_t mean_q8;
+    uint32_t variance_q8;  // population variance, saturates at 0xffffffff
+    uint16_t count;
+    uint16_t min;
+    uint16_t max;
+} stats_summary_t;
+
+void stats_update(uint8_t sensor_index, uint32_t value);
+void stats_get_summary(uint8_t sensor_index, stats_summary_t * summary, uint8_t reset);
+void stats_copy_snapshot(uint8_t sensor_index, uint8_t * buffer);
+void stats_set_window(uint8_t sensor_index, uint16_t window);
+uint16_t stats_get_window(uint8_t sensor_index);
+
+#endif /* STATS_H_ */
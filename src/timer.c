@@ -0,0 +1,70 @@
+/*
+ * timer.c
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "timer.h"
+#include "scheduler.h"
+
+#define TIMER_MICROS_PER_COUNT (8000000L / F_CPU) // Timer0 runs at F_CPU / 8
+
+static volatile uint32_t timer_milliseconds = 0;
+static uint16_t timer_extra_micros = 0; // time Timer0 missed that hasn't added up to a millisecond yet
+
+void timer_init(void){
+    // Timer0 in CTC mode with a clk/8 prescaler, so @ 1MHz it counts at 125kHz
+    // and a compare value of 124 gives us a compare match interrupt every millisecond
+    OCR0A  = (uint8_t) ((F_CPU / 8L / TIMER_TICKS_PER_SECOND) - 1);
+    TCNT0  = 0;
+    TCCR0A = _BV(CTC0) | _BV(CS01);
+    TIMSK0 |= _BV(OCIE0A);
+}
+
+// milliseconds since timer_init, wraps after about 49 days
+// callers should only ever look at differences between two values
+uint32_t timer_millis(void){
+    uint32_t ret = 0;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        ret = timer_milliseconds;
+    }
+    return ret;
+}
+
+// microseconds since timer_init with the 8us resolution of the Timer0 count, wraps after about 71 minutes
+uint32_t timer_micros(void){
+    uint32_t milliseconds = 0;
+    uint16_t extra_micros = 0;
+    uint8_t count = 0;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        milliseconds = timer_milliseconds;
+        extra_micros = timer_extra_micros;
+        count = TCNT0;
+        // the counter may have just cleared with the compare match interrupt still pending
+        if(bit_is_set(TIFR0, OCF0A) && count < OCR0A){
+            milliseconds++;
+        }
+    }
+    return milliseconds * 1000L + extra_micros + ((uint32_t) count) * TIMER_MICROS_PER_COUNT;
+}
+
+/* for time that passed while Timer0 wasn't counting, i.e. ADC noise reduction sleep
+ * which stops the I/O clock, so timer_millis and timer_micros keep up with the wall clock */
+void timer_add_micros(uint16_t micros){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        timer_extra_micros += micros;
+        while(timer_extra_micros >= 1000){
+            timer_extra_micros -= 1000;
+            timer_milliseconds++;
+        }
+    }
+}
+
+ISR(TIMER0_COMPA_vect){
+    SCHEDULER_NOTE_WAKE(SCHEDULER_WAKE_TICK);
+    timer_milliseconds++;
+}
@@ -0,0 +1,19 @@
+/*
+ * timer.h
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#ifndef TIMER_H_
+#define TIMER_H_
+
+#include <stdint.h>
+
+#define TIMER_TICKS_PER_SECOND 1000L
+
+void timer_init(void);
+uint32_t timer_millis(void);
+uint32_t timer_micros(void);
+void timer_add_micros(uint16_t micros);
+
+#endif /* TIMER_H_ */
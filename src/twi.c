@@ -23,6 +23,7 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <compat/twi.h>
+#include <avr/pgmspace.h>
 
 #ifndef cbi
 #define cbi(sfr, bit) (_SFR_BYTE(sfr) &= ~_BV(bit))
@@ -34,20 +35,28 @@
 
 //#include "pins_arduino.h"
 #include "twi.h"
+#include "scheduler.h"
+#include "profile.h"
 
 static volatile uint8_t twi_state;
-static uint8_t twi_slarw;
 
 static void (*twi_onSlaveTransmit)(void);
+static void (*twi_onSlaveTransmitRefill)(void);
 static void (*twi_onSlaveReceive)(uint8_t*, int);
 
+// the module is only ever a slave, master mode is there for TWI_MASTER builds
+#ifdef TWI_MASTER
+static uint8_t twi_slarw;
 static uint8_t twi_masterBuffer[TWI_BUFFER_LENGTH];
 static volatile uint8_t twi_masterBufferIndex;
 static uint8_t twi_masterBufferLength;
+#endif
 
-static uint8_t twi_txBuffer[TWI_BUFFER_LENGTH];
-static volatile uint8_t twi_txBufferIndex;
-static volatile uint8_t twi_txBufferLength;
+static twi_source_t twi_txSource;
+static volatile uint8_t twi_txSourceIndex;
+
+// sent when there is nothing else to send
+static const uint8_t twi_txNothing PROGMEM = 0x00;
 
 static uint8_t twi_rxBuffer[TWI_BUFFER_LENGTH];
 static volatile uint8_t twi_rxBufferIndex;
@@ -96,6 +105,7 @@ void twi_setAddress(uint8_t address)
   TWAR = address << 1;
 }
 
+#ifdef TWI_MASTER
 /* 
  * Function twi_readFrom
  * Desc     attempts to become twi bus master and read a
@@ -216,39 +226,68 @@ uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait
     return 4;	// other twi error
 }
 
+#endif
+
 /* 
- * Function twi_transmit
- * Desc     fills slave tx buffer with data
+ * Function twi_transmitSource
+ * Desc     sets where the slave transmitter takes the next bytes from,
+ *          without copying them. they are fetched one at a time in the
+ *          isr, so the source has to stay valid until they are all sent
  *          must be called in slave tx event callback
- * Input    data: pointer to byte array
- *          length: number of bytes in array
- * Output   1 length too long for buffer
- *          2 not slave transmitter
+ * Input    source: what to send and where it is
+ * Output   2 not slave transmitter
  *          0 ok
  */
-uint8_t twi_transmit(const uint8_t* data, uint8_t length)
+uint8_t twi_transmitSource(const twi_source_t* source)
 {
-  uint8_t i;
-
-  // ensure data will fit into buffer
-  if(TWI_BUFFER_LENGTH < length){
-    return 1;
-  }
-  
   // ensure we are currently a slave transmitter
   if(TWI_STX != twi_state){
     return 2;
   }
-  
-  // set length and copy data into tx buffer
-  twi_txBufferLength = length;
-  for(i = 0; i < length; ++i){
-    twi_txBuffer[i] = data[i];
-  }
-  
+
+  twi_txSource = *source;
+  twi_txSourceIndex = 0;
+
   return 0;
 }
 
+/* 
+ * Function twi_transmitNothing
+ * Desc     sends a single zero, for when the user didn't set a source
+ * Input    none
+ * Output   none
+ */
+static void twi_transmitNothing(void)
+{
+  twi_txSource.type = TWI_SOURCE_PROGMEM;
+  twi_txSource.length = 1;
+  twi_txSource.data = &twi_txNothing;
+  twi_txSourceIndex = 0;
+}
+
+/* 
+ * Function twi_sourceByte
+ * Desc     fetches one byte from a transmit source
+ * Input    source: where the bytes are
+ *          index: which one, from zero
+ * Output   the byte
+ */
+uint8_t twi_sourceByte(const twi_source_t* source, uint8_t index)
+{
+  switch(source->type){
+    case TWI_SOURCE_RAM_REVERSED:
+      return ((const uint8_t*) source->data)[source->length - 1 - index];
+    case TWI_SOURCE_PROGMEM:
+      return pgm_read_byte((const uint8_t*) source->data + index);
+    case TWI_SOURCE_PROGMEM_REVERSED:
+      return pgm_read_byte((const uint8_t*) source->data + source->length - 1 - index);
+    case TWI_SOURCE_GENERATOR:
+      return source->generator(source->data, index);
+    default:
+      return ((const uint8_t*) source->data)[index];
+  }
+}
+
 /* 
  * Function twi_attachSlaveRxEvent
  * Desc     sets function called before a slave read operation
@@ -271,6 +310,20 @@ void twi_attachSlaveTxEvent( void (*function)(void) )
   twi_onSlaveTransmit = function;
 }
 
+/* 
+ * Function twi_attachSlaveTxRefillEvent
+ * Desc     sets function called when the master keeps reading past the end
+ *          of the slave tx source, it sets the next one with twi_transmitSource
+ *          while the bus is held. with one attached the slave never nacks
+ *          a byte, the master ends the read whenever it has enough
+ * Input    function: callback function to use
+ * Output   none
+ */
+void twi_attachSlaveTxRefillEvent( void (*function)(void) )
+{
+  twi_onSlaveTransmitRefill = function;
+}
+
 /* 
  * Function twi_reply
  * Desc     sends byte or readys receive line
@@ -285,6 +338,8 @@ void twi_reply(uint8_t ack)
   }else{
 	  TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWINT);
   }
+  // SCL is let go now, the end of the clock stretch
+  profile_twi_released();
 }
 
 /* 
@@ -297,6 +352,7 @@ void twi_stop(void)
 {
   // send stop condition
   TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA) | _BV(TWINT) | _BV(TWSTO);
+  profile_twi_released();
 
   // wait for stop condition to be exectued on bus
   // TWINT is not set after a stop condition!
@@ -318,6 +374,7 @@ void twi_releaseBus(void)
 {
   // release bus
   TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA) | _BV(TWINT);
+  profile_twi_released();
 
   // update twi state
   twi_state = TWI_READY;
@@ -325,7 +382,13 @@ void twi_releaseBus(void)
 
 ISR(TWI_vect)
 {
+  uint16_t isr_start = profile_start();
+  uint16_t callback_start = 0;
+
+  SCHEDULER_NOTE_WAKE(SCHEDULER_WAKE_TWI);
+
   switch(TW_STATUS){
+#ifdef TWI_MASTER
     // All Master
     case TW_START:     // sent start condition
     case TW_REP_START: // sent repeated start condition
@@ -378,6 +441,7 @@ ISR(TWI_vect)
       twi_stop();
       break;
     // TW_MR_ARB_LOST handled by TW_MT_ARB_LOST case
+#endif
 
     // Slave Receiver
     case TW_SR_SLA_ACK:   // addressed, returned ack
@@ -407,10 +471,13 @@ ISR(TWI_vect)
       if(twi_rxBufferIndex < TWI_BUFFER_LENGTH){
         twi_rxBuffer[twi_rxBufferIndex] = '\0';
       }
-      // sends ack and stops interface for clock stretching
-      twi_stop();
-      // callback to user defined callback
+      // callback to user defined callback while TWINT is still set, so SCL stays low
+      // and a repeated start SLA+R can't get going before the callback has seen the data
+      // (a stop here used to clear TWINT first, and the SLA+R of a combined
+      // write/read transaction then went out before the read address was set)
+      callback_start = profile_start();
       twi_onSlaveReceive(twi_rxBuffer, twi_rxBufferIndex);
+      profile_stop(PROFILE_TWI_ON_RECEIVE, callback_start);
       // since we submit rx buffer to "wire" library, we can reset it
       twi_rxBufferIndex = 0;
       // ack future responses and leave slave receiver state
@@ -427,24 +494,31 @@ ISR(TWI_vect)
     case TW_ST_ARB_LOST_SLA_ACK: // arbitration lost, returned ack
       // enter slave transmitter mode
       twi_state = TWI_STX;
-      // ready the tx buffer index for iteration
-      twi_txBufferIndex = 0;
-      // set tx buffer length to be zero, to verify if user changes it
-      twi_txBufferLength = 0;
-      // request for txBuffer to be filled and length to be set
-      // note: user must call twi_transmit(bytes, length) to do this
+      // nothing to send until the user says otherwise
+      twi_txSource.length = 0;
+      // request for the tx source to be set
+      // note: user must call twi_transmitSource(source) to do this
+      callback_start = profile_start();
       twi_onSlaveTransmit();
-      // if they didn't change buffer & length, initialize it
-      if(0 == twi_txBufferLength){
-        twi_txBufferLength = 1;
-        twi_txBuffer[0] = 0x00;
+      profile_stop(PROFILE_TWI_ON_REQUEST, callback_start);
+      // if they didn't set a source, send a zero
+      if(0 == twi_txSource.length){
+        twi_transmitNothing();
       }
-      // transmit first byte from buffer, fall
+      // transmit first byte from source, fall
     case TW_ST_DATA_ACK: // byte sent, ack returned
-      // copy data to output register
-      TWDR = twi_txBuffer[twi_txBufferIndex++];
-      // if there is more to send, ack, otherwise nack
-      if(twi_txBufferIndex < twi_txBufferLength){
+      // out of data but the master wants more, ask for the next lot
+      if(twi_txSourceIndex >= twi_txSource.length && twi_onSlaveTransmitRefill){
+        twi_txSource.length = 0;
+        twi_onSlaveTransmitRefill();
+        if(0 == twi_txSource.length){
+          twi_transmitNothing();
+        }
+      }
+      // fetch the byte straight into the output register
+      TWDR = twi_sourceByte(&twi_txSource, twi_txSourceIndex++);
+      // if there is more to send (or a refill can provide it), ack, otherwise nack
+      if(twi_txSourceIndex < twi_txSource.length || twi_onSlaveTransmitRefill){
         twi_reply(1);
       }else{
         twi_reply(0);
@@ -466,5 +540,7 @@ ISR(TWI_vect)
       twi_stop();
       break;
   }
+
+  profile_stop(PROFILE_TWI_ISR, isr_start);
 }
 
@@ -28,8 +28,9 @@
   #define TWI_FREQ 100000L
   #endif
 
+  // the longest Egg Bus write frame and its PEC byte, responses don't go through a buffer
   #ifndef TWI_BUFFER_LENGTH
-  #define TWI_BUFFER_LENGTH 16
+  #define TWI_BUFFER_LENGTH 8
   #endif
 
   #define TWI_READY 0
@@ -37,14 +38,33 @@
   #define TWI_MTX   2
   #define TWI_SRX   3
   #define TWI_STX   4
-  
+
+  // where the slave transmitter gets its bytes from, fetched one at a time as they go out
+  #define TWI_SOURCE_RAM          0 // bytes in order from RAM
+  #define TWI_SOURCE_RAM_REVERSED 1 // bytes from RAM last first, a little endian value goes out big endian
+  #define TWI_SOURCE_PROGMEM      2 // bytes in order from flash
+  #define TWI_SOURCE_GENERATOR    3 // byte n is generator(data, n)
+  #define TWI_SOURCE_PROGMEM_REVERSED 4 // bytes from flash last first
+
+  // the data has to stay put until the last byte has gone out
+  typedef struct{
+    uint8_t type;
+    uint8_t length;
+    const void* data;
+    uint8_t (*generator)(const void*, uint8_t);
+  } twi_source_t;
+
   void twi_init(void);
   void twi_setAddress(uint8_t);
+  #ifdef TWI_MASTER
   uint8_t twi_readFrom(uint8_t, uint8_t*, uint8_t);
   uint8_t twi_writeTo(uint8_t, uint8_t*, uint8_t, uint8_t);
-  uint8_t twi_transmit(const uint8_t*, uint8_t);
+  #endif
+  uint8_t twi_transmitSource(const twi_source_t*);
+  uint8_t twi_sourceByte(const twi_source_t*, uint8_t);
   void twi_attachSlaveRxEvent( void (*)(uint8_t*, int) );
   void twi_attachSlaveTxEvent( void (*)(void) );
+  void twi_attachSlaveTxRefillEvent( void (*)(void) );
   void twi_reply(uint8_t);
   void twi_stop(void);
   void twi_releaseBus(void);
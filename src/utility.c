@@ -49,6 +49,11 @@ void big_endian_copy_uint32_to_buffer(uint32_t value, uint8_t * buffer){
     }
 }
 
+void big_endian_copy_uint16_to_buffer(uint16_t value, uint8_t * buffer){
+    buffer[0] = uint16_high_byte(value);
+    buffer[1] = uint16_low_byte(value);
+}
+
 uint32_t get_r1(uint8_t sensor_index){
     return sensor_index == 0 ? NO2_SENSOR_R1 : CO_SENSOR_R1;
 }
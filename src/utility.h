@@ -147,6 +147,23 @@
         CO_R2_PORT &= ~_BV(CO_R2_PIN);\
     } while(0);
 
+#define ALERT_DDR  DDRD
+#define ALERT_PORT PORTD
+#define ALERT_PIN  5
+// open drain, active low alert line to the master (which provides the pull-up)
+#define ALERT_INIT() do{ \
+        ALERT_DDR  &= ~_BV(ALERT_PIN); \
+        ALERT_PORT &= ~_BV(ALERT_PIN); \
+    }while(0)
+// GND output
+#define ALERT_ASSERT() do{ \
+        ALERT_DDR  |= _BV(ALERT_PIN); \
+    }while(0)
+// high impedance input
+#define ALERT_RELEASE() do{ \
+        ALERT_DDR  &= ~_BV(ALERT_PIN); \
+    }while(0)
+
 // low side resistances in ohms
 #define NO2_SENSOR_R1 2200L
 #define NO2_SENSOR_R2 22000L
@@ -173,6 +190,7 @@ uint8_t uint16_high_byte(uint16_t uint16);
 uint8_t uint16_low_byte(uint16_t uint16);
 
 void big_endian_copy_uint32_to_buffer(uint32_t value, uint8_t * buffer);
+void big_endian_copy_uint16_to_buffer(uint16_t value, uint8_t * buffer);
 
 uint32_t get_r1(uint8_t sensor_index);
 uint32_t get_r2(uint8_t sensor_index);
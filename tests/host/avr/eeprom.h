@@ -0,0 +1,17 @@
+/*
+ * avr/eeprom.h
+ *
+ *  host stand-in, EEPROM is just more memory
+ */
+
+#ifndef HOST_AVR_EEPROM_H_
+#define HOST_AVR_EEPROM_H_
+
+#include <string.h>
+
+#define EEMEM
+
+#define eeprom_read_block(destination, source, length) memcpy((destination), (source), (length))
+#define eeprom_write_block(source, destination, length) memcpy((destination), (source), (length))
+
+#endif /* HOST_AVR_EEPROM_H_ */
@@ -0,0 +1,20 @@
+/*
+ * avr/interrupt.h
+ *
+ *  host stand-in, an ISR is a plain function the tests call to deliver the interrupt
+ *  and the global interrupt enable is a flag
+ */
+
+#ifndef HOST_AVR_INTERRUPT_H_
+#define HOST_AVR_INTERRUPT_H_
+
+#include <stdint.h>
+
+extern volatile uint8_t host_interrupts_enabled;
+
+#define sei() (host_interrupts_enabled = 1)
+#define cli() (host_interrupts_enabled = 0)
+
+#define ISR(vector, ...) void vector(void); void vector(void)
+
+#endif /* HOST_AVR_INTERRUPT_H_ */
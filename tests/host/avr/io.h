@@ -0,0 +1,96 @@
+/*
+ * avr/io.h
+ *
+ *  host stand-in for the avr-libc header, just enough of the ATtiny48
+ *  for the firmware sources to build with gcc. the I/O registers are plain
+ *  variables (see host.c) that the tests set up and look at
+ */
+
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+#define _SFR_BYTE(sfr) (sfr)
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+
+extern volatile uint8_t PORTB, DDRB, PINB;
+extern volatile uint8_t PORTC, DDRC, PINC;
+extern volatile uint8_t PORTD, DDRD, PIND;
+
+extern volatile uint8_t ADCSRA, ADMUX, ADCL, ADCH, DIDR0, ACSR, PRR;
+extern volatile uint8_t TCCR0A, TCNT0, OCR0A, TIMSK0, TIFR0;
+extern volatile uint8_t TCCR1A, TCCR1B;
+extern volatile uint16_t TCNT1;
+extern volatile uint8_t TWBR, TWSR, TWAR, TWDR, TWCR;
+extern volatile uint8_t SPCR, SPSR, SPDR;
+
+// ADCSRA
+#define ADEN   7
+#define ADSC   6
+#define ADATE  5
+#define ADIF   4
+#define ADIE   3
+#define ADPS2  2
+#define ADPS1  1
+#define ADPS0  0
+
+// ADMUX
+#define REFS0  6
+#define ADLAR  5
+#define MUX3   3
+#define MUX2   2
+#define MUX1   1
+#define MUX0   0
+
+// DIDR0
+#define ADC0D  0
+
+// ACSR
+#define ACD    7
+
+// PRR
+#define PRTWI  7
+#define PRTIM0 5
+#define PRTIM1 3
+#define PRSPI  2
+#define PRADC  0
+
+// Timer0
+#define CTC0   3
+#define CS02   2
+#define CS01   1
+#define CS00   0
+#define OCIE0A 1
+#define OCF0A  1
+
+// Timer1
+#define CS10   0
+
+// TWI
+#define TWINT  7
+#define TWEA   6
+#define TWSTA  5
+#define TWSTO  4
+#define TWWC   3
+#define TWEN   2
+#define TWIE   0
+#define TWPS1  1
+#define TWPS0  0
+#define TWGCE  0
+
+// SPI
+#define SPIE   7
+#define SPE    6
+#define DORD   5
+#define MSTR   4
+#define CPOL   3
+#define CPHA   2
+#define SPR1   1
+#define SPR0   0
+#define SPIF   7
+#define SPI2X  0
+
+#endif /* HOST_AVR_IO_H_ */
@@ -0,0 +1,23 @@
+/*
+ * avr/pgmspace.h
+ *
+ *  host stand-in, flash is just more memory
+ */
+
+#ifndef HOST_AVR_PGMSPACE_H_
+#define HOST_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+
+#define pgm_read_byte(address) (*(const uint8_t *) (address))
+#define pgm_read_word(address) (*(address))
+#define pgm_read_dword(address) (*(address))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcpy_P strcpy
+
+#endif /* HOST_AVR_PGMSPACE_H_ */
@@ -0,0 +1,25 @@
+/*
+ * avr/sleep.h
+ *
+ *  host stand-in, sleep_cpu() hands over to whatever the test wants to happen while the CPU sleeps
+ */
+
+#ifndef HOST_AVR_SLEEP_H_
+#define HOST_AVR_SLEEP_H_
+
+#include <stdint.h>
+
+#define SLEEP_MODE_IDLE       0
+#define SLEEP_MODE_ADC        1
+#define SLEEP_MODE_PWR_DOWN   2
+
+extern volatile uint8_t host_sleep_mode;
+extern volatile uint8_t host_sleep_enabled;
+void host_sleep_cpu(void);
+
+#define set_sleep_mode(mode) (host_sleep_mode = (mode))
+#define sleep_enable() (host_sleep_enabled = 1)
+#define sleep_disable() (host_sleep_enabled = 0)
+#define sleep_cpu() host_sleep_cpu()
+
+#endif /* HOST_AVR_SLEEP_H_ */
@@ -0,0 +1,46 @@
+/*
+ * host.c
+ *
+ *  the I/O registers and CPU state behind the host stand-in headers
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "host.h"
+
+volatile uint8_t PORTB, DDRB, PINB;
+volatile uint8_t PORTC, DDRC, PINC;
+volatile uint8_t PORTD, DDRD, PIND;
+
+volatile uint8_t ADCSRA, ADMUX, ADCL, ADCH, DIDR0, ACSR, PRR;
+volatile uint8_t TCCR0A, TCNT0, OCR0A, TIMSK0, TIFR0;
+volatile uint8_t TCCR1A, TCCR1B;
+volatile uint16_t TCNT1;
+volatile uint8_t TWBR, TWSR, TWAR, TWDR, TWCR;
+volatile uint8_t SPCR, SPSR, SPDR;
+
+volatile uint8_t host_interrupts_enabled = 0;
+volatile uint8_t host_sleep_mode = SLEEP_MODE_IDLE;
+volatile uint8_t host_sleep_enabled = 0;
+
+void (*host_sleep_hook)(void) = 0;
+uint32_t host_sleep_count = 0;
+
+// the firmware always enables interrupts right before it sleeps, anything else would never wake up
+void host_sleep_cpu(void){
+    host_check(host_sleep_enabled, "sleep_cpu without sleep_enable");
+    host_check(host_interrupts_enabled, "sleep_cpu with interrupts off would never wake up");
+    host_sleep_count++;
+    if(host_sleep_hook){
+        host_sleep_hook();
+    }
+}
+
+uint32_t host_failures = 0;
+
+void host_fail(const char * file, int line, const char * message){
+    fprintf(stderr, "%s:%d: %s\n", file, line, message);
+    host_failures++;
+}
@@ -0,0 +1,27 @@
+/*
+ * host.h
+ *
+ *  what the tests get to see of the host stand-ins, and a minimal check macro
+ */
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+// called every time the firmware goes to sleep, it stands in for whatever interrupt wakes it up
+extern void (*host_sleep_hook)(void);
+extern uint32_t host_sleep_count;
+
+extern uint32_t host_failures;
+void host_fail(const char * file, int line, const char * message);
+
+#define host_check(condition, message) do{ \
+        if(!(condition)) host_fail(__FILE__, __LINE__, (message)); \
+    }while(0)
+
+// what main() of every test returns
+#define host_result(name) (host_failures == 0 ? (printf("%s: ok\n", (name)), 0) : (printf("%s: %lu failures\n", (name), (unsigned long) host_failures), 1))
+
+#endif /* HOST_H_ */
@@ -0,0 +1,23 @@
+/*
+ * util/atomic.h
+ *
+ *  host stand-in, the block runs with the interrupt flag cleared and puts it back afterwards
+ */
+
+#ifndef HOST_UTIL_ATOMIC_H_
+#define HOST_UTIL_ATOMIC_H_
+
+#include <avr/interrupt.h>
+
+static inline uint8_t host_atomic_enter(void){
+    uint8_t ret = host_interrupts_enabled;
+    host_interrupts_enabled = 0;
+    return ret;
+}
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_BLOCK(type) \
+    for(uint8_t host_atomic_saved = host_atomic_enter(), host_atomic_done = 0; !host_atomic_done; \
+            host_interrupts_enabled = host_atomic_saved, host_atomic_done = 1)
+
+#endif /* HOST_UTIL_ATOMIC_H_ */
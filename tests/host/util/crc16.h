@@ -0,0 +1,20 @@
+/*
+ * util/crc16.h
+ *
+ *  host stand-in, same as the C reference in the avr-libc documentation
+ */
+
+#ifndef HOST_UTIL_CRC16_H_
+#define HOST_UTIL_CRC16_H_
+
+#include <stdint.h>
+
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data){
+    crc ^= data;
+    for(uint8_t ii = 0; ii < 8; ii++){
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+    }
+    return crc;
+}
+
+#endif /* HOST_UTIL_CRC16_H_ */
@@ -0,0 +1,201 @@
+/*
+ * test_adc_engine.c
+ *
+ *  the conversion engine against a model of the ADC: the ADC task's pass converts
+ *  every channel once and then leaves the ADC alone, analogRead only returns samples
+ *  from conversions that started after it was called, the sampler's reads and a
+ *  background pass share the rings, and the heater's averages come out of them
+ */
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "host.h"
+#include "adc.h"
+#include "timer.h"
+
+void ADC_vect(void);
+
+static const uint8_t sequence[] = { 0, 2, 1, 3, 6, 7 }; // the sensors, then the heaters in main.c
+#define SEQUENCE_LENGTH sizeof(sequence)
+
+static uint16_t sim_value[8];           // what each channel reads right now
+static uint8_t sim_converting;          // a conversion has been sampled and is running
+static uint16_t sim_sampled;            // what it sampled
+static uint8_t sim_channel;             // on which channel
+static uint8_t sim_order[64];           // channels in the order their conversions started
+static uint8_t sim_started;
+static uint8_t sim_adc_sleeps;
+
+// the sample and hold at the start of a conversion
+static void sim_start(void){
+    sim_channel = ADMUX & 0x0f;
+    sim_sampled = sim_value[sim_channel];
+    sim_converting = 1;
+    if(sim_started < sizeof(sim_order)){
+        sim_order[sim_started] = sim_channel;
+    }
+    sim_started++;
+}
+
+// the end of the running conversion, the ISR may start the next one
+static void sim_finish(void){
+    sim_converting = 0;
+    ADCSRA &= ~_BV(ADSC);
+    ADCL = sim_sampled & 0xff;
+    ADCH = sim_sampled >> 8;
+    ADC_vect();
+    if(ADCSRA & _BV(ADSC)){
+        sim_start();
+    }
+}
+
+// a conversion starts either by writing ADSC or by going to sleep in noise reduction mode
+static void sim_sleep(void){
+    if(!sim_converting && (ADCSRA & _BV(ADEN)) && ((ADCSRA & _BV(ADSC)) || host_sleep_mode == SLEEP_MODE_ADC)){
+        ADCSRA |= _BV(ADSC);
+        sim_start();
+    }
+    if(host_sleep_mode == SLEEP_MODE_ADC){
+        sim_adc_sleeps++;
+    }
+
+    host_check(sim_converting, "sleeping with no conversion running, nothing would wake the CPU");
+    if(sim_converting){
+        sim_finish();
+    }
+}
+
+// what the ISR keeps going while the main loop is busy elsewhere
+static void sim_run_until_idle(void){
+    if(!sim_converting && (ADCSRA & _BV(ADSC))){
+        sim_start();
+    }
+    while(sim_converting){
+        sim_finish();
+    }
+}
+
+static void sim_reset_log(void){
+    sim_started = 0;
+    sim_adc_sleeps = 0;
+}
+
+static void setup(void){
+    host_sleep_hook = sim_sleep;
+    timer_init();
+    for(uint8_t ii = 0; ii < 8; ii++){
+        sim_value[ii] = 100 * ii + 5;
+    }
+    adc_init(sequence, SEQUENCE_LENGTH);
+    host_interrupts_enabled = 1;
+    host_check(ADCSRA & _BV(ADEN), "the ADC isn't on");
+    host_check(!(ADCSRA & _BV(ADSC)), "a conversion started before anything asked for one");
+}
+
+// one pass of the ADC task converts each channel once, in sequence order, and then stops
+static void test_pass(void){
+    adc_set_conversion_mode(ADC_CONVERSION_IDLE);
+    sim_reset_log();
+    adc_run_sequence();
+    host_check(ADCSRA & _BV(ADSC), "the pass didn't start");
+    sim_run_until_idle();
+
+    host_check(sim_started == SEQUENCE_LENGTH, "a pass should be one conversion per channel");
+    for(uint8_t ii = 0; ii < SEQUENCE_LENGTH && ii < sim_started; ii++){
+        host_check(sim_order[ii] == sequence[ii], "the pass went out of sequence order");
+    }
+    host_check(!(ADCSRA & _BV(ADSC)), "the ADC kept converting after the pass");
+
+    for(uint8_t ii = 0; ii < SEQUENCE_LENGTH; ii++){
+        host_check(adc_get_average(sequence[ii]) == sim_value[sequence[ii]], "the first sample should fill the ring");
+    }
+    host_check(sim_started == SEQUENCE_LENGTH, "averaging converted something");
+}
+
+// the heater's average is over the last ADC_RING_DEPTH passes
+static void test_average(void){
+    uint16_t expected = 0;
+
+    for(uint8_t ii = 0; ii < ADC_RING_DEPTH; ii++){
+        sim_value[6] = 200 + 4 * ii;
+        adc_run_sequence();
+        sim_run_until_idle();
+        expected += sim_value[6];
+    }
+    host_check(adc_get_average(6) == expected / ADC_RING_DEPTH, "average of the ring off");
+
+    // and one more pass pushes the oldest out
+    expected -= 200;
+    sim_value[6] = 300;
+    adc_run_sequence();
+    sim_run_until_idle();
+    expected += 300;
+    host_check(adc_get_average(6) == (expected + ADC_RING_DEPTH / 2) / ADC_RING_DEPTH, "the ring didn't move on");
+}
+
+/* a divider switch while the pass is converting the sensor: the conversion in progress sampled the old
+ * level, so analogRead has to wait for one that started after it was called. the rest of the pass
+ * still happens around it */
+static void test_fresh_after_switch(void){
+    sim_value[0] = 111;
+    sim_reset_log();
+    adc_run_sequence();
+    sim_start(); // the sample and hold of channel 0 happened
+    host_check(sim_channel == 0, "the pass should start on the first channel");
+    sim_value[0] = 222; // the divider switched
+
+    host_check(analogRead(0) == 222, "a sample taken before the call came back");
+    sim_run_until_idle();
+    host_check(sim_started == SEQUENCE_LENGTH + 1, "the pass plus one more conversion of the sensor");
+}
+
+// the sampler's back to back reads of its sensor only convert that channel, and leave the ADC idle after
+static void test_sampler_reads(void){
+    sim_reset_log();
+    for(uint8_t ii = 0; ii < 100; ii++){
+        sim_value[2] = 500 + ii;
+        host_check(analogRead(2) == 500 + ii, "wrong sample");
+    }
+    host_check(sim_started == 100, "a read should be exactly one conversion");
+    host_check(!(ADCSRA & _BV(ADSC)) && !sim_converting, "the ADC kept converting after the reads");
+
+    // a pass due in the middle of them takes its turn in between, and both get what they asked for.
+    // the pass hadn't got to the sensor yet, so its conversion there serves the first read as well
+    sim_reset_log();
+    adc_run_sequence();
+    sim_start();
+    for(uint8_t ii = 0; ii < 10; ii++){
+        host_check(analogRead(2) == sim_value[2], "wrong sample with a pass running");
+    }
+    sim_run_until_idle();
+    host_check(sim_started == SEQUENCE_LENGTH + 9, "the pass and the reads should share the stream");
+    host_check(adc_get_average(3) == sim_value[3], "the pass got lost among the reads");
+
+    host_check(analogRead(5) == 0, "a channel outside the sequence read as something");
+}
+
+// in noise reduction mode the pass is done by the task itself, one noise reduction sleep per channel
+static void test_noise_reduction_pass(void){
+    adc_set_conversion_mode(ADC_CONVERSION_NOISE_REDUCTION);
+    sim_reset_log();
+    adc_run_sequence();
+    host_check(sim_started == SEQUENCE_LENGTH, "a pass should be one conversion per channel");
+    host_check(sim_adc_sleeps == SEQUENCE_LENGTH, "each conversion should start from noise reduction sleep");
+    for(uint8_t ii = 0; ii < SEQUENCE_LENGTH && ii < sim_started; ii++){
+        host_check(sim_order[ii] == sequence[ii], "the pass went out of sequence order");
+    }
+    host_check(!(ADCSRA & _BV(ADSC)) && !sim_converting, "the ADC kept converting after the pass");
+    adc_set_conversion_mode(ADC_CONVERSION_IDLE);
+}
+
+int main(void){
+    setup();
+    test_pass();
+    test_average();
+    test_fresh_after_switch();
+    test_sampler_reads();
+    test_noise_reduction_pass();
+    return host_result("test_adc_engine");
+}
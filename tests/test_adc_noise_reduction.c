@@ -0,0 +1,261 @@
+/*
+ * test_adc_noise_reduction.c
+ *
+ *  analogRead in both conversion modes against a model of the ADC, Timer0 and
+ *  the TWI slave, with TWI transactions landing in the middle of conversions.
+ *  In noise reduction mode the I/O clock, and with it Timer0, only runs while
+ *  something other than the ADC has woken the CPU up.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <compat/twi.h>
+#include "host.h"
+#include "adc.h"
+#include "timer.h"
+#include "twi.h"
+
+void ADC_vect(void);
+void TIMER0_COMPA_vect(void);
+void TWI_vect(void);
+
+#define MAX_SLEEPS 16
+
+// something for the TWI to do, at this many microseconds into the conversion
+typedef struct{
+    uint16_t at_us;
+    uint8_t status;
+    uint8_t data;
+} twi_event_t;
+
+static uint32_t sim_now_us;            // the wall clock
+static uint8_t sim_prescaler;          // microseconds towards the next Timer0 count
+static uint8_t sim_adc_was_on;
+static uint8_t sim_adc_busy;
+static uint16_t sim_adc_left_us;
+static uint16_t sim_adc_elapsed_us;
+static uint8_t sim_conversions_started;
+
+static const twi_event_t * sim_events;
+static uint8_t sim_num_events;
+static uint8_t sim_next_event;
+
+static uint8_t sim_sleep_modes[MAX_SLEEPS];
+static uint8_t sim_num_sleeps;
+
+static uint8_t received[TWI_BUFFER_LENGTH];
+static int received_length = -1;
+
+static uint16_t sim_adc_value(uint8_t channel){
+    return 100 + 37 * channel;
+}
+
+static void on_receive(uint8_t * data, int length){
+    for(int ii = 0; ii < length; ii++){
+        received[ii] = data[ii];
+    }
+    received_length = length;
+}
+
+static void on_request(void){
+}
+
+static void sim_advance(uint16_t us, uint8_t io_clock_running){
+    for(uint16_t ii = 0; ii < us; ii++){
+        sim_now_us++;
+        if(io_clock_running && ++sim_prescaler == 8){
+            sim_prescaler = 0;
+            if(TCNT0 == OCR0A){
+                TCNT0 = 0;
+                TIMER0_COMPA_vect();
+            }
+            else{
+                TCNT0++;
+            }
+        }
+    }
+}
+
+static void sim_twi(const twi_event_t * event){
+    TWSR = event->status;
+    TWDR = event->data;
+    TWCR = 0;
+    TWI_vect();
+    host_check(TWCR & _BV(TWINT), "the TWI ISR left SCL stretched");
+}
+
+// what happens while the CPU sleeps, up to and including the interrupt that wakes it
+static void sim_sleep(void){
+    uint8_t mode = host_sleep_mode;
+    uint8_t io_clock_running = (mode != SLEEP_MODE_ADC);
+    uint16_t run_us = 0;
+
+    if(sim_num_sleeps < MAX_SLEEPS){
+        sim_sleep_modes[sim_num_sleeps] = mode;
+    }
+    sim_num_sleeps++;
+
+    host_check(!(ADCSRA & _BV(ADIF)), "sleeping with a conversion result pending");
+
+    // a conversion starts either by writing ADSC or by going to sleep in noise reduction mode
+    if(!sim_adc_busy && (ADCSRA & _BV(ADEN)) && ((ADCSRA & _BV(ADSC)) || mode == SLEEP_MODE_ADC)){
+        sim_adc_busy = 1;
+        sim_adc_left_us = (sim_adc_was_on ? 13 : 25) * 8;
+        sim_adc_elapsed_us = 0;
+        sim_conversions_started++;
+        ADCSRA |= _BV(ADSC);
+    }
+    sim_adc_was_on = (ADCSRA & _BV(ADEN)) ? 1 : 0;
+
+    host_check(sim_adc_busy, "sleeping with no conversion running, nothing would wake the CPU");
+    if(!sim_adc_busy){
+        return;
+    }
+
+    if(sim_next_event < sim_num_events && sim_events[sim_next_event].at_us < sim_adc_elapsed_us + sim_adc_left_us){
+        const twi_event_t * event = &sim_events[sim_next_event++];
+        run_us = event->at_us > sim_adc_elapsed_us ? event->at_us - sim_adc_elapsed_us : 0;
+        sim_advance(run_us, io_clock_running);
+        sim_adc_elapsed_us += run_us;
+        sim_adc_left_us -= run_us;
+        sim_twi(event);
+        return;
+    }
+
+    sim_advance(sim_adc_left_us, io_clock_running);
+    sim_adc_busy = 0;
+    ADCSRA &= ~_BV(ADSC);
+    ADCL = sim_adc_value(ADMUX & 0x0f) & 0xff;
+    ADCH = sim_adc_value(ADMUX & 0x0f) >> 8;
+    ADC_vect();
+}
+
+// one analogRead with TWI events at the given times into the conversion, checks what always has to hold
+static void read_with_events(uint8_t channel, const twi_event_t * events, uint8_t num_events, uint16_t expected_us){
+    uint32_t start_us = timer_micros();
+    uint32_t start_now_us = sim_now_us;
+    uint32_t timer_us = 0;
+    uint16_t value = 0;
+
+    sim_events = events;
+    sim_num_events = num_events;
+    sim_next_event = 0;
+    sim_num_sleeps = 0;
+    sim_conversions_started = 0;
+
+    value = analogRead(channel);
+    timer_us = timer_micros() - start_us;
+
+    host_check(value == sim_adc_value(channel), "wrong conversion result");
+    host_check(sim_conversions_started == 1, "the conversion was started more than once");
+    host_check(sim_next_event == num_events, "a TWI event got lost");
+    host_check(sim_now_us - start_now_us == expected_us, "the conversion took longer than it should");
+    // Timer0 has a resolution of 8us and the wake up is somewhere in between two counts
+    host_check(labs((long) timer_us - (long) expected_us) < 8, "timer_micros lost track of the time");
+    host_check(host_interrupts_enabled, "analogRead left the interrupts off");
+    host_check(!host_sleep_enabled, "analogRead left sleep enabled");
+}
+
+// every channel the reads below use
+static const uint8_t sim_channels[] = { 0, 1, 3, 4, 6, 7 };
+
+static void setup(void){
+    host_sleep_hook = sim_sleep;
+    adc_init(sim_channels, sizeof(sim_channels));
+    timer_init();
+    twi_init();
+    twi_setAddress(0x05);
+    twi_attachSlaveRxEvent(on_receive);
+    twi_attachSlaveTxEvent(on_request);
+    host_interrupts_enabled = 1;
+}
+
+// plain conversions, the first one after power up takes 25 ADC clocks
+static void test_without_twi(void){
+    adc_set_conversion_mode(ADC_CONVERSION_IDLE);
+    read_with_events(3, 0, 0, 200);
+    host_check(sim_num_sleeps == 1 && sim_sleep_modes[0] == SLEEP_MODE_IDLE, "idle mode should idle once");
+
+    adc_set_conversion_mode(ADC_CONVERSION_NOISE_REDUCTION);
+    read_with_events(4, 0, 0, 104);
+    host_check(sim_num_sleeps == 1 && sim_sleep_modes[0] == SLEEP_MODE_ADC, "noise reduction mode should sleep in it once");
+
+    // a channel the engine doesn't convert doesn't get converted
+    host_check(analogRead(2) == 0, "a channel outside the sequence read as something");
+}
+
+/* a whole write transaction while a noise reduction conversion runs, the address match wakes
+ * the CPU out of noise reduction sleep and the rest of the conversion has to be idled through
+ * without starting it again, the byte received and the right result read */
+static void test_twi_during_noise_reduction(void){
+    static const twi_event_t events[] = {
+            { 30, TW_SR_SLA_ACK, 0x00 },
+            { 60, TW_SR_DATA_ACK, 0x42 },
+            { 90, TW_SR_STOP, 0x00 },
+    };
+
+    adc_set_conversion_mode(ADC_CONVERSION_NOISE_REDUCTION);
+    received_length = -1;
+    read_with_events(6, events, 3, 104);
+
+    host_check(received_length == 1 && received[0] == 0x42, "the TWI write didn't come through");
+    host_check(sim_num_sleeps == 4, "should have slept once for the conversion and once after each TWI interrupt");
+    host_check(sim_sleep_modes[0] == SLEEP_MODE_ADC, "the conversion should have started in noise reduction sleep");
+    for(uint8_t ii = 1; ii < 4 && ii < MAX_SLEEPS; ii++){
+        host_check(sim_sleep_modes[ii] == SLEEP_MODE_IDLE, "noise reduction sleep again would have restarted the conversion");
+    }
+    host_check(adc_get_conversion_mode() == ADC_CONVERSION_NOISE_REDUCTION, "the conversion mode changed");
+
+    // and the next conversion goes back to noise reduction sleep
+    read_with_events(7, 0, 0, 104);
+    host_check(sim_num_sleeps == 1 && sim_sleep_modes[0] == SLEEP_MODE_ADC, "not back in noise reduction mode");
+
+    // the same in idle mode, all idle sleeps
+    adc_set_conversion_mode(ADC_CONVERSION_IDLE);
+    received_length = -1;
+    read_with_events(6, events, 3, 104);
+    host_check(received_length == 1 && received[0] == 0x42, "the TWI write didn't come through");
+    host_check(sim_num_sleeps == 4, "should have slept once for the conversion and once after each TWI interrupt");
+    for(uint8_t ii = 0; ii < 4 && ii < MAX_SLEEPS; ii++){
+        host_check(sim_sleep_modes[ii] == SLEEP_MODE_IDLE, "idle mode should only idle");
+    }
+}
+
+/* lots of conversions with the odd address match somewhere in them,
+ * without the compensation timer_millis would lose about 104ms per thousand */
+static void test_no_drift(void){
+    twi_event_t event = { 0, TW_SR_SLA_ACK, 0x00 };
+    uint32_t start_ms = timer_millis();
+    uint32_t start_now_us = sim_now_us;
+    long drift_us = 0;
+
+    adc_set_conversion_mode(ADC_CONVERSION_NOISE_REDUCTION);
+    srand(1);
+    for(uint16_t ii = 0; ii < 10000; ii++){
+        if(ii % 5 == 0){
+            event.at_us = rand() % 104;
+            read_with_events(sim_channels[ii % sizeof(sim_channels)], &event, 1, 104);
+            // finish the transaction off so the next address match is a fresh one
+            event.status = TW_SR_STOP;
+            sim_twi(&event);
+            event.status = TW_SR_SLA_ACK;
+        }
+        else{
+            read_with_events(sim_channels[ii % sizeof(sim_channels)], 0, 0, 104);
+        }
+    }
+
+    drift_us = (long) (timer_millis() - start_ms) * 1000L - (long) (sim_now_us - start_now_us);
+    host_check(labs(drift_us) <= 1000, "timer_millis drifted");
+}
+
+int main(void){
+    setup();
+    test_without_twi();
+    test_twi_during_noise_reduction();
+    test_no_drift();
+    return host_result("test_adc_noise_reduction");
+}
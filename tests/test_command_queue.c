@@ -0,0 +1,76 @@
+/*
+ * test_command_queue.c
+ *
+ *  the deferred write queue: writes come out in the order they went in, a full
+ *  queue turns writes away and counts them, the high water mark and depth
+ *  follow along, and all of that still holds once the byte-wide indices wrap
+ */
+
+#include <stdint.h>
+#include "host.h"
+#include "command_queue.h"
+
+static uint16_t next_address;   // what the producer pushes next, the consumer checks against expected_address
+static uint16_t expected_address;
+
+static uint8_t push(void){
+    if(command_queue_push(next_address, 0x10000UL * next_address + 7)){
+        next_address++;
+        return 1;
+    }
+    return 0;
+}
+
+static void pop_expecting(uint8_t count){
+    command_t command;
+    for(uint8_t ii = 0; ii < count; ii++){
+        host_check(command_queue_pop(&command), "the queue ran dry early");
+        host_check(command.address == expected_address && command.value == 0x10000UL * expected_address + 7,
+                "a write came out of order or changed");
+        expected_address++;
+    }
+}
+
+static void test_empty(void){
+    command_t command;
+    host_check(!command_queue_pop(&command), "an empty queue gave something up");
+    host_check(command_queue_get_depth() == 0, "an empty queue has depth");
+}
+
+// fills up, turns the next ones away without touching what's queued, then drains in order
+static void test_full(void){
+    for(uint8_t ii = 0; ii < COMMAND_QUEUE_LENGTH; ii++){
+        host_check(push(), "the queue turned a write away before it was full");
+        host_check(command_queue_get_depth() == ii + 1, "depth off while filling");
+    }
+    host_check(command_queue_get_high_water() == COMMAND_QUEUE_LENGTH, "high water mark off");
+
+    host_check(!push() && !push(), "a full queue took a write");
+    host_check(command_queue_get_overflow_count() == 2, "overflows not counted");
+    host_check(command_queue_get_depth() == COMMAND_QUEUE_LENGTH, "an overflow changed the depth");
+
+    pop_expecting(COMMAND_QUEUE_LENGTH);
+    test_empty();
+    host_check(command_queue_get_high_water() == COMMAND_QUEUE_LENGTH, "the high water mark should stay");
+}
+
+// a producer that keeps a step ahead of the consumer, for long enough that head and tail wrap many times
+static void test_wrap(void){
+    for(uint16_t ii = 0; ii < 1000; ii++){
+        host_check(push(), "a write turned away with room to spare");
+        if(ii % 3 == 0){
+            host_check(push(), "a write turned away with room to spare");
+        }
+        pop_expecting(command_queue_get_depth() > 1 ? 2 : 1);
+    }
+    pop_expecting(command_queue_get_depth());
+    test_empty();
+    host_check(command_queue_get_overflow_count() == 2, "overflows counted with room to spare");
+}
+
+int main(void){
+    test_empty();
+    test_full();
+    test_wrap();
+    return host_result("test_command_queue");
+}
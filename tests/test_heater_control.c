@@ -0,0 +1,363 @@
+/*
+ * test_heater_control.c
+ *
+ *  the PI heater control against a thermal model of both heaters: an adjustable regulator
+ *  set by the digipot wiper, the heater and its feedback resistor in series, a heater
+ *  resistance that rises with its temperature a few seconds behind the power, and the
+ *  10-bit ADC on both ends. the ±momentum loop main.c ran before the PI controller runs
+ *  against the same model, and both report how long they take to settle and how far they overshoot
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "host.h"
+#include "heater_control.h"
+#include "digipot.h"
+#include "egg_bus.h"
+#include "main.h"
+
+#define UPDATE_PERIOD_S     3.0  // SCHEDULER_HEATER_PERIOD_MS
+#define MODEL_STEP_S        0.01
+#define AMBIENT_C           25.0
+
+typedef struct{
+    double feedback_ohms;
+    double cold_ohms;      // heater resistance at ambient
+    double tempco;         // per degree
+    double thermal_c_per_mw;
+    double time_constant_s;
+    double regulator_max_v; // at wiper 0, a higher wiper means a lower voltage
+    double regulator_min_v; // at DIGIPOT_WIPER_MAX
+    double temperature_c;
+    double peak_over_mw;   // furthest above and below the target since the last harness_reset
+    double peak_under_mw;
+} heater_model_t;
+
+static heater_model_t heaters[EGG_BUS_NUM_HOSTED_SENSORS];
+static uint16_t wipers[2];   // by wiper number
+
+static const uint8_t sensor_wiper[EGG_BUS_NUM_HOSTED_SENSORS] = { DIGIPOT_WIPER1, DIGIPOT_WIPER0 };
+
+/* stand-ins for the drivers heater_control.c uses */
+
+uint16_t digipot_get_wiper(uint8_t wiper_num){
+    return wipers[wiper_num == DIGIPOT_WIPER1 ? 1 : 0];
+}
+
+void digipot_write_wiper(uint8_t wiper_num, uint16_t value){
+    host_check(value <= DIGIPOT_WIPER_MAX, "wiper written past full scale");
+    wipers[wiper_num == DIGIPOT_WIPER1 ? 1 : 0] = value;
+}
+
+uint16_t profile_start(void){
+    return 0;
+}
+
+void profile_stop(uint8_t point, uint16_t start){
+}
+
+/* the plant */
+
+static double model_regulator_v(uint8_t sensor_index){
+    heater_model_t * h = &heaters[sensor_index];
+    double wiper = digipot_get_wiper(sensor_wiper[sensor_index]);
+    return h->regulator_max_v - (h->regulator_max_v - h->regulator_min_v) * wiper / DIGIPOT_WIPER_MAX;
+}
+
+static double model_heater_ohms(uint8_t sensor_index){
+    heater_model_t * h = &heaters[sensor_index];
+    return h->cold_ohms * (1.0 + h->tempco * (h->temperature_c - AMBIENT_C));
+}
+
+static double model_current_a(uint8_t sensor_index){
+    return model_regulator_v(sensor_index) / (model_heater_ohms(sensor_index) + heaters[sensor_index].feedback_ohms);
+}
+
+static double model_power_mw(uint8_t sensor_index){
+    double current = model_current_a(sensor_index);
+    return current * current * model_heater_ohms(sensor_index) * 1000.0;
+}
+
+static void model_run(double seconds){
+    for(double t = 0; t < seconds; t += MODEL_STEP_S){
+        for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+            heater_model_t * h = &heaters[ii];
+            double power_mw = model_power_mw(ii);
+            double error_mw = power_mw - heater_control_get_target_power_mw(ii);
+            double settled_c = AMBIENT_C + h->thermal_c_per_mw * power_mw;
+            h->temperature_c += (settled_c - h->temperature_c) * MODEL_STEP_S / h->time_constant_s;
+            if(error_mw > h->peak_over_mw){
+                h->peak_over_mw = error_mw;
+            }
+            if(-error_mw > h->peak_under_mw){
+                h->peak_under_mw = -error_mw;
+            }
+        }
+    }
+}
+
+static uint16_t adc_counts(double volts){
+    long ret = lround(volts / 5.0 * 1024.0);
+    return ret > 1023 ? 1023 : (uint16_t) ret;
+}
+
+uint16_t adc_get_average(uint8_t channel_num){
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        if(channel_num == heater_control_get_power_adc_channel(ii)){
+            return adc_counts(model_regulator_v(ii));
+        }
+        if(channel_num == heater_control_get_feedback_adc_channel(ii)){
+            return adc_counts(model_current_a(ii) * heaters[ii].feedback_ohms);
+        }
+    }
+    host_check(0, "conversion on a channel that isn't a heater's");
+    return 0;
+}
+
+/* the loop main.c ran before the PI controller: every update the wiper moves one way or the other by
+ * the momentum, which goes up by one for every update in the same direction and back to one when it turns.
+ * the digipot's increment and decrement commands stop at the ends of its travel */
+
+static uint8_t momentum[EGG_BUS_NUM_HOSTED_SENSORS];
+static int8_t last_direction[EGG_BUS_NUM_HOSTED_SENSORS];
+
+// heater_control_get_heater_power_mw's sum, on fresh readings
+static uint32_t momentum_measured_mw(uint8_t sensor_index){
+    uint16_t power_voltage = adc_get_average(heater_control_get_power_adc_channel(sensor_index));
+    uint16_t feedback_voltage = adc_get_average(heater_control_get_feedback_adc_channel(sensor_index));
+    uint32_t ret = (1000L * ((uint32_t) (power_voltage - feedback_voltage) * (uint32_t) feedback_voltage))
+            / (uint32_t) lround(heaters[sensor_index].feedback_ohms);
+    return ret * 5L * 5L / (1024L * 1024L);
+}
+
+static void momentum_update(uint8_t sensor_index){
+    uint8_t wiper_num = sensor_wiper[sensor_index];
+    int32_t wiper = digipot_get_wiper(wiper_num);
+    uint32_t target_power_mw = heater_control_get_target_power_mw(sensor_index);
+    uint32_t heater_power_mw = momentum_measured_mw(sensor_index);
+    int8_t direction = 0;
+
+    if(heater_power_mw > target_power_mw){
+        wiper += momentum[sensor_index]; // cool down a bit
+    }
+    else if(heater_power_mw < target_power_mw){
+        wiper -= momentum[sensor_index]; // heat up a bit
+    }
+    wiper = wiper < 0 ? 0 : wiper > DIGIPOT_WIPER_MAX ? DIGIPOT_WIPER_MAX : wiper;
+    if(wiper != digipot_get_wiper(wiper_num)){
+        digipot_write_wiper(wiper_num, (uint16_t) wiper);
+    }
+
+    direction = (int32_t) target_power_mw - (int32_t) heater_power_mw > 0 ? 1 : -1;
+    if(direction == last_direction[sensor_index]){
+        momentum[sensor_index]++; // change faster
+    }
+    else{
+        momentum[sensor_index] = 1; // reset to slow changes
+    }
+    last_direction[sensor_index] = direction;
+}
+
+static void pi_update(uint8_t sensor_index){
+    heater_control_manage(sensor_index);
+}
+
+typedef void (*controller_t)(uint8_t sensor_index);
+
+/* the harness */
+
+/* the two heaters are different parts: the NO2 one is the smaller and lighter of the two, so it runs
+ * at less power and follows it faster. both take seconds to warm through, about one update period */
+static void model_reset(void){
+    heaters[0].feedback_ohms = NO2_HEATER_FEEDBACK_RESISTANCE;
+    heaters[0].cold_ohms = 50.0;
+    heaters[0].tempco = 0.0030;
+    heaters[0].thermal_c_per_mw = 5.0;
+    heaters[0].time_constant_s = 2.0;
+    heaters[1].feedback_ohms = CO_HEATER_FEEDBACK_RESISTANCE;
+    heaters[1].cold_ohms = 55.0;
+    heaters[1].tempco = 0.0025;
+    heaters[1].thermal_c_per_mw = 4.0;
+    heaters[1].time_constant_s = 4.0;
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        heaters[ii].regulator_max_v = 5.0;
+        heaters[ii].regulator_min_v = 1.25;
+        heaters[ii].temperature_c = AMBIENT_C;
+    }
+}
+
+// clears the overshoot peaks and the momentum loop's state, the heaters stay as they are
+static void harness_reset(void){
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        heaters[ii].peak_over_mw = 0;
+        heaters[ii].peak_under_mw = 0;
+        momentum[ii] = 1;
+        last_direction[ii] = 0;
+    }
+}
+
+// one heater task run every UPDATE_PERIOD_S, the way the scheduler does it
+static void run_updates(controller_t controller, uint16_t n){
+    for(uint16_t ii = 0; ii < n; ii++){
+        model_run(UPDATE_PERIOD_S);
+        for(uint8_t jj = 0; jj < EGG_BUS_NUM_HOSTED_SENSORS; jj++){
+            controller(jj);
+        }
+    }
+}
+
+// updates until both heaters are within tolerance_mw of their target and stay there for 10 more
+static uint16_t updates_to_settle(controller_t controller, uint16_t limit, double tolerance_mw){
+    uint16_t in_band = 0;
+    for(uint16_t ii = 1; ii <= limit; ii++){
+        uint8_t all_in = 1;
+        run_updates(controller, 1);
+        for(uint8_t jj = 0; jj < EGG_BUS_NUM_HOSTED_SENSORS; jj++){
+            if(fabs(model_power_mw(jj) - heater_control_get_target_power_mw(jj)) > tolerance_mw){
+                all_in = 0;
+            }
+        }
+        in_band = all_in ? in_band + 1 : 0;
+        if(in_band == 10){
+            return ii - 9;
+        }
+    }
+    return 0xffff;
+}
+
+// the error the controller reports is the measured one, the ADC resolution limits how close it gets
+#define TOLERANCE_MW 2.0
+
+// how far past the target a heater went on the side it approached from
+static double overshoot_mw(uint8_t sensor_index, uint8_t from_below){
+    return from_below ? heaters[sensor_index].peak_over_mw : heaters[sensor_index].peak_under_mw;
+}
+
+typedef struct{
+    uint16_t updates;
+    double overshoot_mw[EGG_BUS_NUM_HOSTED_SENSORS];
+    uint16_t wiper_span[EGG_BUS_NUM_HOSTED_SENSORS];   // how far the wiper wanders in the 30 updates after settling
+} step_result_t;
+
+static void run_step(controller_t controller, uint16_t wiper, step_result_t * result){
+    uint8_t from_below[EGG_BUS_NUM_HOSTED_SENSORS];
+    uint16_t lowest[EGG_BUS_NUM_HOSTED_SENSORS];
+    uint16_t highest[EGG_BUS_NUM_HOSTED_SENSORS];
+
+    model_reset();
+    harness_reset();
+    wipers[0] = wipers[1] = wiper;
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        // the heater starts cold, so where it ends up depends on the wiper as much as on the temperature
+        model_run(10 * heaters[ii].time_constant_s);
+        from_below[ii] = model_power_mw(ii) < heater_control_get_target_power_mw(ii);
+    }
+    harness_reset();
+
+    result->updates = updates_to_settle(controller, 100, TOLERANCE_MW);
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        result->overshoot_mw[ii] = overshoot_mw(ii, from_below[ii]);
+        lowest[ii] = highest[ii] = digipot_get_wiper(sensor_wiper[ii]);
+    }
+    for(uint8_t ii = 0; ii < 30; ii++){
+        run_updates(controller, 1);
+        for(uint8_t jj = 0; jj < EGG_BUS_NUM_HOSTED_SENSORS; jj++){
+            uint16_t wiper = digipot_get_wiper(sensor_wiper[jj]);
+            lowest[jj] = wiper < lowest[jj] ? wiper : lowest[jj];
+            highest[jj] = wiper > highest[jj] ? wiper : highest[jj];
+        }
+    }
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        result->wiper_span[ii] = highest[ii] - lowest[ii];
+    }
+}
+
+static void print_step(const char * name, const step_result_t * result){
+    printf("test_heater_control:   %-8s settled within %.0fmW after %3u updates, overshoot NO2 %4.1fmW CO %4.1fmW, settled wiper span NO2 %u CO %u\n",
+            name, TOLERANCE_MW, result->updates, result->overshoot_mw[0], result->overshoot_mw[1], result->wiper_span[0], result->wiper_span[1]);
+}
+
+/* from the wiper the digipot powers up with (mid scale) and from either end of its travel,
+ * the PI controller against the momentum loop it replaced */
+static void test_step_from(uint16_t wiper, const char * name){
+    step_result_t pi;
+    step_result_t baseline;
+
+    run_step(pi_update, wiper, &pi);
+    run_step(momentum_update, wiper, &baseline);
+    printf("test_heater_control: from wiper %u (%s)\n", wiper, name);
+    print_step("PI", &pi);
+    print_step("momentum", &baseline);
+
+    host_check(pi.updates <= 20, "took longer than a minute to settle");
+    host_check(pi.updates <= baseline.updates, "slower to settle than the momentum loop");
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        host_check(pi.overshoot_mw[ii] <= 0.1 * heater_control_get_target_power_mw(ii), "overshot by more than 10%");
+        host_check(pi.overshoot_mw[ii] <= baseline.overshoot_mw[ii] + TOLERANCE_MW, "overshot further than the momentum loop");
+        // once settled the wiper can only toggle between the two steps either side of the target, on CO one step is less than the ADC resolves
+        host_check(pi.wiper_span[ii] <= 1, "the wiper hunts around the target");
+    }
+}
+
+// the supply to the regulator sags by 20%, then the heaters age and run 30% hotter
+static void test_disturbances(void){
+    uint16_t updates = 0;
+
+    model_reset();
+    harness_reset();
+    wipers[0] = wipers[1] = DIGIPOT_WIPER_MAX / 2;
+    run_updates(pi_update, 30);
+
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        heaters[ii].regulator_max_v *= 0.8;
+        heaters[ii].regulator_min_v *= 0.8;
+    }
+    updates = updates_to_settle(pi_update, 60, TOLERANCE_MW);
+    printf("test_heater_control: recovered from a 20%% supply sag after %u updates\n", updates);
+    host_check(updates <= 20, "didn't recover from the supply sag");
+
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        heaters[ii].cold_ohms *= 1.3;
+    }
+    updates = updates_to_settle(pi_update, 60, TOLERANCE_MW);
+    printf("test_heater_control: recovered from 30%% more heater resistance after %u updates\n", updates);
+    host_check(updates <= 20, "didn't recover from the heater resistance change");
+}
+
+/* with the supply too low to reach the target the wiper runs into its end stop and stays there,
+ * none of the error gets saved up, so it comes straight back once the supply does */
+static void test_no_windup(void){
+    uint16_t updates = 0;
+    model_reset();
+    harness_reset();
+    wipers[0] = wipers[1] = DIGIPOT_WIPER_MAX / 2;
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        heaters[ii].regulator_max_v = 1.0;
+    }
+    run_updates(pi_update, 100);
+    host_check(wipers[0] == 0 && wipers[1] == 0, "the wiper should be at the high voltage end");
+
+    // the heaters get the full supply until the next update, after that it's up to the controller
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        heaters[ii].regulator_max_v = 5.0;
+    }
+    run_updates(pi_update, 1);
+    harness_reset();
+    updates = updates_to_settle(pi_update, 60, TOLERANCE_MW);
+    printf("test_heater_control: back from the end stop after %u updates\n", updates);
+    host_check(updates <= 20, "wound up at the end stop");
+    for(uint8_t ii = 0; ii < EGG_BUS_NUM_HOSTED_SENSORS; ii++){
+        printf("test_heater_control:   %s came down from %.1fmW over and undershot by %.1fmW\n", ii ? "CO" : "NO2", heaters[ii].peak_over_mw, heaters[ii].peak_under_mw);
+        // on the way down from the end stop's full supply, a wound up integral would carry it well past the target
+        host_check(heaters[ii].peak_under_mw <= 0.1 * heater_control_get_target_power_mw(ii), "wound up at the end stop, undershot on the way back");
+    }
+}
+
+int main(void){
+    test_step_from(DIGIPOT_WIPER_MAX / 2, "mid scale");
+    test_step_from(0, "too hot");
+    test_step_from(DIGIPOT_WIPER_MAX, "too cold");
+    test_disturbances();
+    test_no_windup();
+    return host_result("test_heater_control");
+}
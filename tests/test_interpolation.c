@@ -0,0 +1,93 @@
+/*
+ * test_interpolation.c
+ *
+ *  the ppb lookup table against what the master computes from the mapping table and
+ *  scaler registers: straight lines between the table points, worked out in double precision
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "host.h"
+#include "interpolation.h"
+#include "sensor_math.h"
+
+// the same as MAX_ERROR_PERCENT in tools/gen_interpolation_lut.py
+#define MAX_ERROR_PERCENT 4.0
+
+static float scaler(const uint8_t * p){
+    float ret = 0;
+    memcpy(&ret, p, sizeof(ret));
+    return ret;
+}
+
+static uint8_t table_length(uint8_t sensor_index){
+    uint8_t ret = 0;
+    while(getTableValue(sensor_index, ret, 0) != 0xff){
+        ret++;
+    }
+    return ret;
+}
+
+// the independent value at table point ii
+static double table_x(uint8_t sensor_index, uint8_t ii){
+    return getTableValue(sensor_index, ii, 0) * (double) scaler(get_p_x_scaler(sensor_index))
+            * get_independent_scaler_inverse(sensor_index);
+}
+
+static double table_y(uint8_t sensor_index, uint8_t ii){
+    return getTableValue(sensor_index, ii, 1) * (double) scaler(get_p_y_scaler(sensor_index));
+}
+
+static double linear_ppb(uint8_t sensor_index, double x){
+    uint8_t length = table_length(sensor_index);
+
+    if(x <= table_x(sensor_index, 0)){
+        return table_y(sensor_index, 0);
+    }
+    for(uint8_t ii = 0; ii + 1 < length; ii++){
+        double x0 = table_x(sensor_index, ii);
+        double x1 = table_x(sensor_index, ii + 1);
+        if(x <= x1){
+            return table_y(sensor_index, ii) + (table_y(sensor_index, ii + 1) - table_y(sensor_index, ii)) * (x - x0) / (x1 - x0);
+        }
+    }
+    return table_y(sensor_index, length - 1);
+}
+
+// every independent value across the table, and a way either side of it
+static void test_against_linear(uint8_t sensor_index, const char * name){
+    uint8_t length = table_length(sensor_index);
+    uint32_t first = (uint32_t) table_x(sensor_index, 0);
+    uint32_t last = (uint32_t) table_x(sensor_index, length - 1);
+    double worst = 0;
+    double total = 0;
+    uint32_t count = 0;
+
+    for(uint32_t x = first / 4; x <= last * 4; x++){
+        double expected = linear_ppb(sensor_index, x);
+        double error = fabs((double) interpolation_compute_ppb(sensor_index, x) - expected) / expected * 100.0;
+        if(error > worst){
+            worst = error;
+        }
+        total += error;
+        count++;
+    }
+
+    printf("test_interpolation: %s vs linear interpolation over %lu values, mean %.2f%% max %.2f%%\n",
+            name, (unsigned long) count, total / count, worst);
+    host_check(worst <= MAX_ERROR_PERCENT, "the lookup table strays too far from the table");
+
+    // the ends, no reading at all and an open circuit
+    host_check(fabs(interpolation_compute_ppb(sensor_index, 0) - table_y(sensor_index, 0)) <= table_y(sensor_index, 0) * MAX_ERROR_PERCENT / 100.0,
+            "zero should clamp to the first table point");
+    host_check(fabs(interpolation_compute_ppb(sensor_index, SENSOR_MATH_INFINITY) - table_y(sensor_index, length - 1)) <= table_y(sensor_index, length - 1) * MAX_ERROR_PERCENT / 100.0,
+            "infinity should clamp to the last table point");
+}
+
+int main(void){
+    test_against_linear(0, "no2");
+    test_against_linear(1, "co");
+    host_check(interpolation_compute_ppb(2, 1000) == 0, "there is no third sensor");
+    return host_result("test_interpolation");
+}
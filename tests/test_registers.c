@@ -0,0 +1,527 @@
+/*
+ * test_registers.c
+ *
+ *  the register descriptor tables against the nested switches they replaced: for every
+ *  one of the 65536 addresses the streaming span has to be the same, and so does the
+ *  response wherever it is built in the response buffer. the modules behind the
+ *  registers are stubbed out with getters that give every field a value of its own.
+ *  the fields that are sent straight from flash, RAM or a generator have to give the master
+ *  the same bytes, through twi_sourceByte, as the copies the old map made of them.
+ *  it gets built twice, test_registers_debug has INCLUDE_DEBUG_REGISTERS defined
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "host.h"
+#include "registers.h"
+#include "egg_bus.h"
+#include "main.h"
+#include "utility.h"
+#include "digipot.h"
+#include "heater_control.h"
+#include "interpolation.h"
+#include "sampler.h"
+#include "filter.h"
+#include "history.h"
+#include "stats.h"
+#include "alarm.h"
+#include "scheduler.h"
+#include "profile.h"
+
+#ifdef INCLUDE_DEBUG_REGISTERS
+#define TEST_NAME "test_registers_debug"
+#else
+#define TEST_NAME "test_registers"
+#endif
+
+/* the stand-ins, each getter's value is made up of its own tag and the sensor index */
+
+uint8_t macaddr[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0x55 };
+volatile uint8_t scheduler_wake_source;
+
+static uint8_t stub_valid;  // whether the sensors have been sampled yet
+
+static uint32_t stub_value(uint8_t tag, uint8_t sensor_index){
+    return 0x81000000UL ^ ((uint32_t) tag << 16) ^ ((uint32_t) sensor_index << 8) ^ (tag * 37U);
+}
+
+void sampler_get_sample(uint8_t sensor_index, sensor_sample_t * sample){
+    memset(sample, 0, sizeof(sensor_sample_t));
+    sample->independent_value = stub_value(1, sensor_index);
+    sample->computed_value = stub_value(2, sensor_index);
+    sample->timestamp_ms = stub_value(3, sensor_index);
+    sample->adc_value = (uint16_t) stub_value(4, sensor_index);
+    sample->adc_bits = 10 + sensor_index;
+    sample->range_index = sensor_index + 1;
+    sample->valid = stub_valid;
+}
+
+uint32_t sampler_get_age_ms(uint8_t sensor_index){ return stub_value(5, sensor_index); }
+uint32_t sampler_get_low_side_resistance(uint8_t sensor_index, uint8_t range_index){ return stub_value(6 + range_index, sensor_index); }
+uint16_t sampler_get_settle_time_us(uint8_t sensor_index, uint8_t range_index){ return (uint16_t) stub_value(9 + range_index, sensor_index); }
+uint8_t sampler_get_oversampling(uint8_t sensor_index){ return (uint8_t) stub_value(12, sensor_index); }
+void sampler_set_oversampling(uint8_t sensor_index, uint8_t oversampling){ }
+
+void sampler_copy_snapshot(uint8_t * buffer){
+    for(uint8_t ii = 0; ii < SAMPLER_SNAPSHOT_LENGTH; ii++){
+        buffer[ii] = 0xa0 + ii;
+    }
+}
+
+uint8_t filter_get_median_length(uint8_t sensor_index){ return (uint8_t) stub_value(13, sensor_index); }
+void filter_set_median_length(uint8_t sensor_index, uint8_t length){ }
+uint8_t filter_get_ewma_shift(uint8_t sensor_index){ return (uint8_t) stub_value(14, sensor_index); }
+void filter_set_ewma_shift(uint8_t sensor_index, uint8_t shift){ }
+uint32_t filter_get_output(uint8_t sensor_index){ return stub_value(15, sensor_index); }
+
+uint16_t history_get_interval(uint8_t sensor_index){ return (uint16_t) stub_value(16, sensor_index); }
+void history_set_interval(uint8_t sensor_index, uint16_t interval_ticks){ }
+
+void history_get_info(uint8_t sensor_index, uint8_t * buffer){
+    big_endian_copy_uint32_to_buffer(stub_value(17, sensor_index), buffer);
+    big_endian_copy_uint32_to_buffer(stub_value(18, sensor_index), buffer + 4);
+}
+
+// three entries recorded, as many of them from first_entry on as fit
+uint8_t history_copy_entries(uint8_t sensor_index, uint8_t first_entry, uint8_t * buffer, uint8_t buffer_length){
+    uint8_t length = 0;
+    for(uint8_t ii = first_entry; ii < 3 && length + HISTORY_ENTRY_LENGTH <= buffer_length; ii++){
+        big_endian_copy_uint32_to_buffer(stub_value(19 + ii, sensor_index), buffer + length);
+        length += HISTORY_ENTRY_LENGTH;
+    }
+    return length;
+}
+
+void stats_get_summary(uint8_t sensor_index, stats_summary_t * summary, uint8_t reset){
+    summary->mean_q8 = stub_value(22, sensor_index);
+    summary->variance_q8 = stub_value(23, sensor_index);
+    summary->count = (uint16_t) stub_value(24, sensor_index);
+    summary->min = (uint16_t) stub_value(25, sensor_index);
+    summary->max = (uint16_t) stub_value(26, sensor_index);
+}
+
+void stats_copy_snapshot(uint8_t sensor_index, uint8_t * buffer){
+    for(uint8_t ii = 0; ii < STATS_SNAPSHOT_LENGTH; ii++){
+        buffer[ii] = (uint8_t) stub_value(27 + ii, sensor_index);
+    }
+}
+
+uint16_t stats_get_window(uint8_t sensor_index){ return (uint16_t) stub_value(43, sensor_index); }
+void stats_set_window(uint8_t sensor_index, uint16_t window){ }
+
+uint32_t alarm_get_threshold(uint8_t sensor_index){ return stub_value(44, sensor_index); }
+void alarm_set_threshold(uint8_t sensor_index, uint32_t threshold){ }
+uint8_t alarm_get_config(uint8_t sensor_index){ return (uint8_t) stub_value(45, sensor_index); }
+void alarm_set_config(uint8_t sensor_index, uint8_t config){ }
+uint8_t alarm_get_status(uint8_t sensor_index){ return (uint8_t) stub_value(46, sensor_index); }
+void alarm_clear_status(uint8_t sensor_index, uint8_t mask){ }
+
+uint16_t heater_control_get_kp(uint8_t sensor_index){ return (uint16_t) stub_value(47, sensor_index); }
+void heater_control_set_kp(uint8_t sensor_index, uint16_t kp){ }
+uint16_t heater_control_get_ki(uint8_t sensor_index){ return (uint16_t) stub_value(48, sensor_index); }
+void heater_control_set_ki(uint8_t sensor_index, uint16_t ki){ }
+uint16_t heater_control_get_heater_power_voltage(uint8_t sensor_index){ return (uint16_t) stub_value(49, sensor_index); }
+uint16_t heater_control_get_heater_feedback_voltage(uint8_t sensor_index){ return (uint16_t) stub_value(50, sensor_index); }
+uint32_t heater_control_get_heater_power_mw(uint8_t sensor_index){ return stub_value(51, sensor_index); }
+
+// the old debug registers read the digipot over SPI, the new ones from the shadow, both give the same here
+uint16_t digipot_get_wiper(uint8_t wiper_num){ return (uint16_t) stub_value(52, wiper_num == DIGIPOT_WIPER1 ? 0 : 1); }
+uint16_t digipot_read_wiper1(){ return digipot_get_wiper(DIGIPOT_WIPER1); }
+uint16_t digipot_read_wiper0(){ return digipot_get_wiper(DIGIPOT_WIPER0); }
+uint16_t digipot_get_status(void){ return (uint16_t) stub_value(53, 0); }
+uint16_t digipot_read_status(){ return digipot_get_status(); }
+
+uint16_t scheduler_get_period(uint8_t task_index){ return (uint16_t) stub_value(54, task_index); }
+void scheduler_set_period(uint8_t task_index, uint16_t period_ms){ }
+uint16_t scheduler_get_idle_permille(void){ return (uint16_t) stub_value(55, 0); }
+uint32_t scheduler_get_idle_ms(void){ return stub_value(56, 0); }
+uint32_t scheduler_get_wake_count(uint8_t source){ return stub_value(57, source); }
+
+/* the register map as it was before the descriptor tables, fill_response and get_field_span
+ * from main.c. the only changes are to keep up with the getters: the type and units strings
+ * are read out of flash here rather than by egg_bus, and the filtered value has moved from
+ * the sample to the filter */
+
+static uint8_t reference_fill_response(uint16_t address, uint8_t * response){
+    uint8_t response_length = 4; // unless it gets overridden 4 is the default
+    uint8_t sensor_index = 0;
+    uint8_t sensor_field_offset = 0;
+    uint16_t sensor_block_relative_address = address - ((uint16_t) EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS);
+    uint32_t responseValue = 0;
+    sensor_sample_t sample;
+    stats_summary_t summary;
+    switch(address){
+    case EGG_BUS_ADDRESS_SENSOR_COUNT:
+        response[0] = EGG_BUS_NUM_HOSTED_SENSORS;
+        response_length = 1;
+        break;
+    case EGG_BUS_ADDRESS_MODULE_ID:
+        memcpy(response, macaddr, 6);
+        response_length = 6;
+        break;
+    case EGG_BUS_FIRMWARE_VERSION:
+        big_endian_copy_uint32_to_buffer(EGG_BUS_FIRMWARE_VERSION_NUMBER, response);
+        break;
+    case EGG_BUS_CAPABILITIES:
+        big_endian_copy_uint32_to_buffer(EGG_BUS_CAPABILITIES_VALUE, response);
+        break;
+    case EGG_BUS_CONFIG:
+        big_endian_copy_uint32_to_buffer((uint32_t) egg_bus_get_config(), response);
+        break;
+    case EGG_BUS_PEC_ERROR_COUNT:
+        big_endian_copy_uint32_to_buffer(egg_bus_get_pec_error_count(), response);
+        break;
+    case EGG_BUS_SNAPSHOT_FRAME:
+        sampler_copy_snapshot(response);
+        response_length = SAMPLER_SNAPSHOT_LENGTH;
+        break;
+#ifdef INCLUDE_DEBUG_REGISTERS
+    case EGG_BUS_DEBUG_NO2_HEATER_VOLTAGE_PLUS:
+        big_endian_copy_uint32_to_buffer(heater_control_get_heater_power_voltage(0), response);
+        break;
+    case EGG_BUS_DEBUG_NO2_HEATER_VOLTAGE_MINUS:
+        big_endian_copy_uint32_to_buffer(heater_control_get_heater_feedback_voltage(0), response);
+        break;
+    case EGG_BUS_DEBUG_NO2_HEATER_POWER_MW:
+        big_endian_copy_uint32_to_buffer(heater_control_get_heater_power_mw(0), response);
+        break;
+    case EGG_BUS_DEBUG_NO2_DIGIPOT_WIPER:
+        big_endian_copy_uint32_to_buffer((uint32_t) digipot_read_wiper1(), response);
+        break;
+    case EGG_BUS_DEBUG_CO_HEATER_VOLTAGE_PLUS:
+        big_endian_copy_uint32_to_buffer(heater_control_get_heater_power_voltage(1), response);
+        break;
+    case EGG_BUS_DEBUG_CO_HEATER_VOLTAGE_MINUS:
+        big_endian_copy_uint32_to_buffer(heater_control_get_heater_feedback_voltage(1), response);
+        break;
+    case EGG_BUS_DEBUG_CO_HEATER_POWER_MW:
+        big_endian_copy_uint32_to_buffer(heater_control_get_heater_power_mw(1), response);
+        break;
+    case EGG_BUS_DEBUG_CO_DIGIPOT_WIPER:
+        big_endian_copy_uint32_to_buffer((uint32_t) digipot_read_wiper0(), response);
+        break;
+    case EGG_BUS_DEBUG_DIGIPOT_STATUS:
+        big_endian_copy_uint32_to_buffer((uint32_t) digipot_read_status(), response);
+        break;
+#endif
+    default:
+        if(address >= EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS){
+            sensor_index = sensor_block_relative_address / ((uint16_t) EGG_BUS_SENSOR_BLOCK_SIZE);
+            sensor_field_offset = sensor_block_relative_address % ((uint16_t) EGG_BUS_SENSOR_BLOCK_SIZE);
+            switch(sensor_field_offset){
+            case EGG_BUS_SENSOR_BLOCK_TYPE_OFFSET:
+                strcpy_P((char *) response, egg_bus_get_sensor_type_P(sensor_index));
+                response_length = 16;
+                break;
+            case EGG_BUS_SENSOR_BLOCK_UNITS_OFFSET:
+                strcpy_P((char *) response, egg_bus_get_sensor_units_P(sensor_index));
+                response_length = 16;
+                break;
+            case EGG_BUS_SENSOR_BLOCK_R0_OFFSET:
+                big_endian_copy_uint32_to_buffer(egg_bus_get_r0_ohms(sensor_index), response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_TABLE_X_SCALER_OFFSET:
+                memcpy(&responseValue, get_p_x_scaler(sensor_index), 4);
+                big_endian_copy_uint32_to_buffer(responseValue, response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_TABLE_Y_SCALER_OFFSET:
+                memcpy(&responseValue, get_p_y_scaler(sensor_index), 4);
+                big_endian_copy_uint32_to_buffer(responseValue, response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_MEASURED_INDEPENDENT_SCALER_OFFSET:
+                memcpy(&responseValue, get_p_independent_scaler(sensor_index), 4);
+                big_endian_copy_uint32_to_buffer(responseValue, response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_MEASURED_INDEPENDENT_OFFSET:
+                sampler_get_sample(sensor_index, &sample);
+                big_endian_copy_uint32_to_buffer(sample.valid ? sample.independent_value : 0xffffffff, response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_RAW_VALUE_OFFSET:
+                sampler_get_sample(sensor_index, &sample);
+                response_length = 9;
+                big_endian_copy_uint32_to_buffer((uint32_t) sample.adc_value, response);
+                big_endian_copy_uint32_to_buffer(sampler_get_low_side_resistance(sensor_index, sample.range_index), response + 4);
+                response[8] = sample.adc_bits;
+                break;
+            case EGG_BUS_SENSOR_BLOCK_COMPUTED_VALUE_OFFSET:
+                sampler_get_sample(sensor_index, &sample);
+                big_endian_copy_uint32_to_buffer(sample.valid ? sample.computed_value : 0xffffffff, response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_SAMPLE_AGE_OFFSET:
+                big_endian_copy_uint32_to_buffer(sampler_get_age_ms(sensor_index), response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_OVERSAMPLING_OFFSET:
+                big_endian_copy_uint32_to_buffer((uint32_t) sampler_get_oversampling(sensor_index), response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_FILTER_MEDIAN_LENGTH_OFFSET:
+                big_endian_copy_uint32_to_buffer((uint32_t) filter_get_median_length(sensor_index), response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_FILTER_EWMA_SHIFT_OFFSET:
+                big_endian_copy_uint32_to_buffer((uint32_t) filter_get_ewma_shift(sensor_index), response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_FILTERED_VALUE_OFFSET:
+                sampler_get_sample(sensor_index, &sample);
+                big_endian_copy_uint32_to_buffer(sample.valid ? filter_get_output(sensor_index) : 0xffffffff, response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_HISTORY_INTERVAL_OFFSET:
+                big_endian_copy_uint32_to_buffer((uint32_t) history_get_interval(sensor_index), response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_HISTORY_INFO_OFFSET:
+                history_get_info(sensor_index, response);
+                response_length = HISTORY_INFO_LENGTH;
+                break;
+            case EGG_BUS_SENSOR_BLOCK_STATS_MIN_OFFSET:
+                stats_get_summary(sensor_index, &summary, 0);
+                big_endian_copy_uint32_to_buffer((uint32_t) summary.min, response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_STATS_MAX_OFFSET:
+                stats_get_summary(sensor_index, &summary, 0);
+                big_endian_copy_uint32_to_buffer((uint32_t) summary.max, response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_STATS_MEAN_OFFSET:
+                stats_get_summary(sensor_index, &summary, 0);
+                big_endian_copy_uint32_to_buffer(summary.mean_q8, response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_STATS_VARIANCE_OFFSET:
+                stats_get_summary(sensor_index, &summary, 0);
+                big_endian_copy_uint32_to_buffer(summary.variance_q8, response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_STATS_COUNT_OFFSET:
+                stats_get_summary(sensor_index, &summary, 0);
+                big_endian_copy_uint32_to_buffer((uint32_t) summary.count, response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_STATS_WINDOW_OFFSET:
+                big_endian_copy_uint32_to_buffer((uint32_t) stats_get_window(sensor_index), response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_STATS_SNAPSHOT_OFFSET:
+                stats_copy_snapshot(sensor_index, response);
+                response_length = STATS_SNAPSHOT_LENGTH;
+                break;
+            case EGG_BUS_SENSOR_BLOCK_ALARM_THRESHOLD_OFFSET:
+                big_endian_copy_uint32_to_buffer(alarm_get_threshold(sensor_index), response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_ALARM_CONFIG_OFFSET:
+                big_endian_copy_uint32_to_buffer((uint32_t) alarm_get_config(sensor_index), response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_ALARM_STATUS_OFFSET:
+                big_endian_copy_uint32_to_buffer((uint32_t) alarm_get_status(sensor_index), response);
+                break;
+            case EGG_BUS_SENSOR_BLOCK_SETTLE_TIMES_OFFSET:
+                response_length = 4 * SAMPLER_NUM_RANGES;
+                for(uint8_t ii = 0; ii < SAMPLER_NUM_RANGES; ii++){
+                    big_endian_copy_uint32_to_buffer((uint32_t) sampler_get_settle_time_us(sensor_index, ii), response + 4 * ii);
+                }
+                break;
+            default:
+                if(sensor_field_offset >= EGG_BUS_SENSOR_BLOCK_HISTORY_ENTRIES_OFFSET
+                        && sensor_field_offset < EGG_BUS_SENSOR_BLOCK_HISTORY_ENTRIES_OFFSET + HISTORY_ENTRY_LENGTH * HISTORY_MAX_DEPTH){
+                    response_length = history_copy_entries(sensor_index,
+                            (sensor_field_offset - EGG_BUS_SENSOR_BLOCK_HISTORY_ENTRIES_OFFSET) / HISTORY_ENTRY_LENGTH,
+                            response, EGG_BUS_MAX_RESPONSE_LENGTH);
+                    break;
+                }
+
+                sensor_block_relative_address = (sensor_field_offset - EGG_BUS_SENSOR_BLOCK_COMPUTED_VALUE_MAPPING_TABLE_BASE_OFFSET);
+                sensor_block_relative_address >>= 3;
+                response_length = 2;
+
+                *(response)   = getTableValue(sensor_index, sensor_block_relative_address, 0);
+                *(response+1) = getTableValue(sensor_index, sensor_block_relative_address, 1);
+
+                break;
+            }
+        }
+        break;
+    }
+
+    return response_length;
+}
+
+static uint8_t reference_get_field_span(uint16_t address){
+    uint16_t sensor_block_relative_address = address - ((uint16_t) EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS);
+    uint8_t sensor_field_offset = 0;
+
+    switch(address){
+    case EGG_BUS_ADDRESS_SENSOR_COUNT:
+        return 1;
+    case EGG_BUS_ADDRESS_MODULE_ID:
+        return 6;
+    case EGG_BUS_FIRMWARE_VERSION:
+    case EGG_BUS_CAPABILITIES:
+    case EGG_BUS_CONFIG:
+    case EGG_BUS_PEC_ERROR_COUNT:
+        return 4;
+    case EGG_BUS_SNAPSHOT_FRAME:
+        return SAMPLER_SNAPSHOT_LENGTH;
+    }
+
+#ifdef INCLUDE_DEBUG_REGISTERS
+    if(address >= EGG_BUS_DEBUG_BLOCK_BASE_ADDRESS){
+        return address <= EGG_BUS_DEBUG_DIGIPOT_STATUS && ((address - EGG_BUS_DEBUG_BLOCK_BASE_ADDRESS) & 3) == 0 ? 4 : 0;
+    }
+#endif
+
+    if(address < EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS
+            || sensor_block_relative_address >= EGG_BUS_NUM_HOSTED_SENSORS * EGG_BUS_SENSOR_BLOCK_SIZE){
+        return 0;
+    }
+
+    sensor_field_offset = sensor_block_relative_address % ((uint16_t) EGG_BUS_SENSOR_BLOCK_SIZE);
+    switch(sensor_field_offset){
+    case EGG_BUS_SENSOR_BLOCK_TYPE_OFFSET:
+    case EGG_BUS_SENSOR_BLOCK_UNITS_OFFSET:
+        return 16;
+    case EGG_BUS_SENSOR_BLOCK_SETTLE_TIMES_OFFSET:
+        return 4 * SAMPLER_NUM_RANGES;
+    case EGG_BUS_SENSOR_BLOCK_HISTORY_INFO_OFFSET:
+        return HISTORY_INFO_LENGTH;
+    case EGG_BUS_SENSOR_BLOCK_STATS_SNAPSHOT_OFFSET:
+        return 4 | FIELD_SPAN_NOT_STREAMED;
+    }
+
+    if(sensor_field_offset >= EGG_BUS_SENSOR_BLOCK_COMPUTED_VALUE_MAPPING_TABLE_BASE_OFFSET
+            && sensor_field_offset < EGG_BUS_SENSOR_BLOCK_SAMPLE_AGE_OFFSET){
+        return ((sensor_field_offset - EGG_BUS_SENSOR_BLOCK_COMPUTED_VALUE_MAPPING_TABLE_BASE_OFFSET) & 7) == 0 ? 8 : 0;
+    }
+
+    if(sensor_field_offset >= EGG_BUS_SENSOR_BLOCK_R0_OFFSET
+            && sensor_field_offset <= EGG_BUS_SENSOR_BLOCK_ALARM_STATUS_OFFSET
+            && (sensor_field_offset & 3) == 0){
+        return 4;
+    }
+
+    return 0;
+}
+
+/* the differences there are meant to be */
+
+// fields that came after the descriptor tables, the old map had nothing there
+static uint8_t added_since(uint16_t address){
+    uint8_t offset = (address - EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS) & 0xff;
+
+    if(address >= EGG_BUS_COMMAND_QUEUE_STATUS && address < EGG_BUS_COMMAND_QUEUE_OVERFLOW_COUNT + 4){
+        return 1;
+    }
+    if(address >= EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS
+            && address < EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS + EGG_BUS_NUM_HOSTED_SENSORS * EGG_BUS_SENSOR_BLOCK_SIZE
+            && offset >= EGG_BUS_SENSOR_BLOCK_HEATER_KP_OFFSET){
+        return 1;
+    }
+    if(address >= EGG_BUS_SCHEDULER_BLOCK_BASE_ADDRESS && address < EGG_BUS_SCHEDULER_IDLE_MS + 4){
+        return 1;
+    }
+    if(address >= EGG_BUS_DEBUG_WAKE_COUNTS){
+        return 1;
+    }
+    return 0;
+}
+
+/* the old span check let every 4-byte boundary from R0 to the last alarm register through,
+ * including the ones inside the settle times and the history info, which then read as a mapping
+ * table entry. there is no field there, so now they read as empty like any other such address */
+static uint8_t inside_a_longer_field(uint16_t address){
+    uint8_t offset = (address - EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS) & 0xff;
+
+    if(address < EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS
+            || address >= EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS + EGG_BUS_NUM_HOSTED_SENSORS * EGG_BUS_SENSOR_BLOCK_SIZE){
+        return 0;
+    }
+    return offset == EGG_BUS_SENSOR_BLOCK_SETTLE_TIMES_OFFSET + 4 || offset == EGG_BUS_SENSOR_BLOCK_SETTLE_TIMES_OFFSET + 8
+            || offset == EGG_BUS_SENSOR_BLOCK_HISTORY_INFO_OFFSET + 4;
+}
+
+// the raw value is 9 bytes long, the old map streamed past it after 4
+static uint8_t span_fixed_since(uint16_t address){
+    uint8_t offset = (address - EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS) & 0xff;
+
+    return address >= EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS
+            && address < EGG_BUS_SENSOR_BLOCK_BASE_ADDRESS + EGG_BUS_NUM_HOSTED_SENSORS * EGG_BUS_SENSOR_BLOCK_SIZE
+            && offset == EGG_BUS_SENSOR_BLOCK_RAW_VALUE_OFFSET;
+}
+
+static uint32_t num_fields;
+static uint32_t num_sourced;
+static uint32_t num_added;
+static uint32_t num_inside;
+
+// every address, span first and then the response the first read of it gets
+static void test_all_addresses(void){
+    uint8_t expected[EGG_BUS_MAX_RESPONSE_LENGTH];
+    uint8_t response[EGG_BUS_MAX_RESPONSE_LENGTH];
+    twi_source_t source;
+
+    for(uint32_t address = 0; address <= 0xffff; address++){
+        uint8_t span = registers_get_span((uint16_t) address);
+        uint8_t expected_span = reference_get_field_span((uint16_t) address);
+        uint8_t expected_length = 0;
+
+        if(added_since((uint16_t) address)){
+            host_check(expected_span == 0, "a field added since is on top of an old one");
+            num_added += span != 0;
+            continue;
+        }
+        if(inside_a_longer_field((uint16_t) address)){
+            host_check(expected_span == 4 && span == 0, "the middle of a longer field changed");
+            num_inside++;
+            continue;
+        }
+
+        if(span_fixed_since((uint16_t) address)){
+            host_check(expected_span == 4 && span == 9, "the raw value span changed again");
+        }
+        else{
+            host_check(span == expected_span, "span differs from the old map");
+        }
+        if(span == 0){
+            continue;
+        }
+        num_fields++;
+
+        memset(expected, 0, sizeof(expected));
+        expected_length = reference_fill_response((uint16_t) address, expected);
+        registers_get_source((uint16_t) address, &source, response);
+        host_check(source.length == expected_length, "response length differs from the old map");
+
+        if(source.type == TWI_SOURCE_RAM && source.data == response){
+            host_check(memcmp(response, expected, sizeof(expected)) == 0, "response differs from the old map");
+        }
+        else{
+            // sent straight from where the bytes are, byte by byte the way the TWI ISR does it
+            num_sourced++;
+            for(uint8_t ii = 0; ii < source.length && ii < sizeof(expected); ii++){
+                host_check(twi_sourceByte(&source, ii) == expected[ii], "a source gives different bytes than the old copy");
+            }
+        }
+    }
+}
+
+// each kind of source on its own, the byte order of the reversed ones above all
+static void test_source_types(void){
+    static const uint8_t flash[4] PROGMEM = { 1, 2, 3, 4 };
+    uint8_t ram[4] = { 5, 6, 7, 8 };
+    twi_source_t source;
+
+    source.length = 4;
+    source.type = TWI_SOURCE_RAM;
+    source.data = ram;
+    host_check(twi_sourceByte(&source, 0) == 5 && twi_sourceByte(&source, 3) == 8, "RAM source");
+    source.type = TWI_SOURCE_RAM_REVERSED;
+    host_check(twi_sourceByte(&source, 0) == 8 && twi_sourceByte(&source, 3) == 5, "reversed RAM source");
+    source.type = TWI_SOURCE_PROGMEM;
+    source.data = flash;
+    host_check(twi_sourceByte(&source, 0) == 1 && twi_sourceByte(&source, 3) == 4, "flash source");
+    source.type = TWI_SOURCE_PROGMEM_REVERSED;
+    host_check(twi_sourceByte(&source, 0) == 4 && twi_sourceByte(&source, 3) == 1, "reversed flash source");
+}
+
+int main(void){
+    for(stub_valid = 0; stub_valid < 2; stub_valid++){
+        num_fields = num_sourced = num_added = num_inside = 0;
+        test_all_addresses();
+    }
+    test_source_types();
+    printf("%s: %lu fields as before (%lu of them sent from a source), %lu addresses with fields added since, %lu inside longer fields\n",
+            TEST_NAME, (unsigned long) num_fields, (unsigned long) num_sourced, (unsigned long) num_added, (unsigned long) num_inside);
+    return host_result(TEST_NAME);
+}
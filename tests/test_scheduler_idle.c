@@ -0,0 +1,245 @@
+/*
+ * test_scheduler_idle.c
+ *
+ *  the scheduler's idle sleep with the Timer0 tick and the TWI slave modelled around it:
+ *  master reads arrive while the CPU is asleep, SLA+W and SLA+R have to be answered
+ *  from the sleep with SCL let go, every wake gets put down to the right source,
+ *  and the idle share has to come out as the time the tasks left over.
+ *  Timer1 doesn't move while the model's ISR runs, so each interrupt's clock stretch
+ *  comes out as just the entry cycles, once for each time SCL was let go
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <setjmp.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <compat/twi.h>
+#include "host.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "twi.h"
+#include "profile.h"
+
+void TIMER0_COMPA_vect(void);
+void TWI_vect(void);
+
+#define RUN_SECONDS          10
+#define HEATER_TASK_US       2000  // two heater updates, four conversions and the SPI
+#define SAMPLER_TASK_US      29000 // two sensors at 100 conversions of about 135us each, and the filters
+#define TWI_BYTE_US          90    // a byte and its ack at 100kHz
+
+// what the master does: a READ command, a repeated start and four bytes back, every 100ms
+typedef struct{
+    uint16_t after_us; // since the one before
+    uint8_t status;
+    uint8_t data;      // what the master sends, for the receiver states
+} twi_event_t;
+
+static const twi_event_t transaction[] = {
+        { 0,           TW_SR_SLA_ACK,  0x00 },
+        { TWI_BYTE_US, TW_SR_DATA_ACK, 0x11 },
+        { TWI_BYTE_US, TW_SR_DATA_ACK, 0x00 },
+        { TWI_BYTE_US, TW_SR_DATA_ACK, 0x24 },
+        { TWI_BYTE_US, TW_SR_STOP,     0x00 }, // the repeated start
+        { 20,          TW_ST_SLA_ACK,  0x00 },
+        { TWI_BYTE_US, TW_ST_DATA_ACK, 0x00 },
+        { TWI_BYTE_US, TW_ST_DATA_ACK, 0x00 },
+        { TWI_BYTE_US, TW_ST_DATA_ACK, 0x00 },
+        { TWI_BYTE_US, TW_ST_DATA_NACK, 0x00 },
+};
+#define TRANSACTION_LENGTH (sizeof(transaction) / sizeof(transaction[0]))
+#define TRANSACTION_PERIOD_US 100000L
+
+static const uint8_t response[4] = { 0xde, 0xad, 0xbe, 0xef };
+static twi_source_t response_source;
+
+static uint32_t sim_now_us;
+static uint8_t sim_prescaler;
+static uint8_t sim_in_task;
+static uint32_t sim_transaction_us;
+static uint32_t sim_next_twi_us;
+static uint8_t sim_next_twi;
+static uint32_t sim_busy_us;
+
+static uint32_t twi_events;
+static uint32_t twi_events_asleep;
+static uint32_t transactions_done;
+static uint8_t sent[4];
+static uint8_t sent_length;
+static uint32_t reads_ok;
+static uint32_t writes_ok;
+
+static jmp_buf done;
+static uint8_t led_runs;
+
+static void on_receive(uint8_t * data, int length){
+    host_check(length == 3 && data[0] == 0x11 && data[1] == 0x00 && data[2] == 0x24, "the READ command came in wrong");
+    writes_ok++;
+}
+
+static void on_request(void){
+    response_source.type = TWI_SOURCE_RAM;
+    response_source.length = sizeof(response);
+    response_source.data = response;
+    twi_transmitSource(&response_source);
+    sent_length = 0;
+}
+
+// the master's side of each byte, and checks that the ISR let go of SCL whatever the state
+static void sim_twi(const twi_event_t * event){
+    twi_events++;
+    if(!sim_in_task){
+        host_check(host_sleep_enabled && host_sleep_mode == SLEEP_MODE_IDLE, "TWI served outside the idle sleep");
+        twi_events_asleep++;
+    }
+
+    TWSR = event->status;
+    TWDR = event->data;
+    TWCR = 0;
+    TWI_vect();
+    host_check(TWCR & _BV(TWINT), "SCL held low after the TWI ISR");
+
+    // the data register is what goes out next on the slave transmitter states
+    if(event->status == TW_ST_SLA_ACK || event->status == TW_ST_DATA_ACK){
+        if(sent_length < sizeof(sent)){
+            sent[sent_length++] = TWDR;
+        }
+    }
+    if(event->status == TW_ST_DATA_NACK){
+        if(sent_length == sizeof(sent) && memcmp(sent, response, sizeof(sent)) == 0){
+            reads_ok++;
+        }
+        transactions_done++;
+    }
+}
+
+// one microsecond, returns non-zero if an interrupt came in
+static uint8_t sim_step(void){
+    uint8_t ret = 0;
+    sim_now_us++;
+    if(sim_in_task){
+        sim_busy_us++;
+    }
+
+    if(++sim_prescaler == 8){
+        sim_prescaler = 0;
+        if(TCNT0 == OCR0A){
+            TCNT0 = 0;
+            TIMER0_COMPA_vect();
+            ret = 1;
+        }
+        else{
+            TCNT0++;
+        }
+    }
+
+    if(sim_now_us >= sim_next_twi_us){
+        sim_twi(&transaction[sim_next_twi]);
+        ret = 1;
+        if(++sim_next_twi == TRANSACTION_LENGTH){
+            sim_next_twi = 0;
+            sim_transaction_us += TRANSACTION_PERIOD_US;
+            sim_next_twi_us = sim_transaction_us;
+        }
+        else{
+            sim_next_twi_us += transaction[sim_next_twi].after_us;
+        }
+    }
+    return ret;
+}
+
+// the idle sleep lasts until the first interrupt
+static void sim_sleep(void){
+    host_check(host_sleep_mode == SLEEP_MODE_IDLE, "the scheduler should only ever idle");
+    while(!sim_step()){
+    }
+}
+
+// a task keeps the CPU for this long, interrupts and all
+static void sim_busy(uint32_t us){
+    sim_in_task = 1;
+    for(uint32_t ii = 0; ii < us; ii++){
+        sim_step();
+    }
+    sim_in_task = 0;
+}
+
+static void heater_task(void){
+    sim_busy(HEATER_TASK_US);
+}
+
+static void sampler_task(void){
+    sim_busy(SAMPLER_TASK_US);
+}
+
+static void deferred_task(void){
+}
+
+// the conversions have a test of their own, there is no ADC in this model
+static void adc_task(void){
+}
+
+static void led_task(void){
+    if(++led_runs > RUN_SECONDS){
+        longjmp(done, 1);
+    }
+}
+
+static const scheduler_task_t tasks[SCHEDULER_NUM_TASKS] = {
+        heater_task,
+        sampler_task,
+        deferred_task,
+        led_task,
+        adc_task
+};
+
+int main(void){
+    uint32_t expected_permille = 0;
+    uint32_t wakes = 0;
+
+    host_sleep_hook = sim_sleep;
+    timer_init();
+    twi_init();
+    twi_setAddress(0x05);
+    twi_attachSlaveRxEvent(on_receive);
+    twi_attachSlaveTxEvent(on_request);
+    // the first transaction lands 50ms in, clear of the tasks that all run at start up,
+    // and none of them line up with a tick
+    sim_transaction_us = 50333;
+    sim_next_twi_us = sim_transaction_us;
+    host_interrupts_enabled = 1;
+
+    if(!setjmp(done)){
+        scheduler_init(tasks);
+        scheduler_run();
+    }
+
+    // every read was answered, and most from the sleep (the rest land during the sampler task)
+    printf("test_scheduler_idle: %lu transactions, %lu of %lu TWI interrupts came in asleep\n",
+            (unsigned long) transactions_done, (unsigned long) twi_events_asleep, (unsigned long) twi_events);
+    host_check(transactions_done >= RUN_SECONDS * 10 - 1, "transactions went missing");
+    host_check(reads_ok == transactions_done, "a read came back wrong");
+    host_check(writes_ok >= transactions_done, "a READ command came in wrong");
+    host_check(twi_events_asleep > twi_events / 2, "hardly any TWI came in while asleep, the test isn't testing much");
+    host_check(profile_get_stretch_cycles() == twi_events * PROFILE_TWI_ENTRY_CYCLES, "clock stretch miscounted");
+
+    // each TWI interrupt that came in asleep is a wake, the rest are ticks, there is no ADC here
+    wakes = scheduler_get_wake_count(SCHEDULER_WAKE_TICK) + scheduler_get_wake_count(SCHEDULER_WAKE_TWI);
+    printf("test_scheduler_idle: wakes tick %lu TWI %lu ADC %lu other %lu\n",
+            (unsigned long) scheduler_get_wake_count(SCHEDULER_WAKE_TICK), (unsigned long) scheduler_get_wake_count(SCHEDULER_WAKE_TWI),
+            (unsigned long) scheduler_get_wake_count(SCHEDULER_WAKE_ADC), (unsigned long) scheduler_get_wake_count(SCHEDULER_WAKE_OTHER));
+    host_check(scheduler_get_wake_count(SCHEDULER_WAKE_TWI) == twi_events_asleep, "TWI wakes miscounted");
+    host_check(scheduler_get_wake_count(SCHEDULER_WAKE_ADC) == 0 && scheduler_get_wake_count(SCHEDULER_WAKE_OTHER) == 0, "wakes from nowhere");
+    host_check(wakes == host_sleep_count, "a sleep without a wake");
+
+    // the tasks are the only thing keeping the CPU busy in the model
+    expected_permille = 1000 - (sim_busy_us * 1000L) / sim_now_us;
+    printf("test_scheduler_idle: idle %u permille, %lu expected from the task time\n",
+            scheduler_get_idle_permille(), (unsigned long) expected_permille);
+    host_check(scheduler_get_idle_permille() + 15 >= expected_permille && scheduler_get_idle_permille() <= expected_permille + 15,
+            "idle share off");
+
+    return host_result("test_scheduler_idle");
+}
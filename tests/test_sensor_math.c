@@ -0,0 +1,134 @@
+/*
+ * test_sensor_math.c
+ *
+ *  the integer sensor math against a double precision reference, for every ADC code
+ *  at every oversampling setting on every divider range of both sensors
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include "host.h"
+#include "sensor_math.h"
+#include "sampler.h"
+#include "interpolation.h"
+#include "utility.h"
+
+// the R0 values the independent variable gets checked with, the defaults among them
+static const uint32_t r0_ohms[] = { 1, 100, 2200, 10000, 750000, 10000000 };
+#define NUM_R0 (sizeof(r0_ohms) / sizeof(r0_ohms[0]))
+
+// where the exact answer is a whole number the double can come out a hair under it
+#define SLACK 1e-6
+
+static uint32_t low_side_resistance(uint8_t sensor_index, uint8_t range_index){
+    uint32_t ret = get_r1(sensor_index);
+    if(range_index < 2){
+        ret += get_r2(sensor_index);
+    }
+    if(range_index < 1){
+        ret += get_r3(sensor_index);
+    }
+    return ret;
+}
+
+// the products and quotients the kernel is built from, against 64-bit arithmetic
+static void test_kernel(void){
+    uint32_t high = 0;
+    uint32_t low = 0;
+
+    srand(7);
+    for(uint32_t ii = 0; ii < 1000000; ii++){
+        // a spread of magnitudes, not just big random numbers
+        uint32_t a = ((uint32_t) rand() << 16 ^ (uint32_t) rand()) >> (rand() % 32);
+        uint32_t b = ((uint32_t) rand() << 16 ^ (uint32_t) rand()) >> (rand() % 32);
+        uint32_t c = ((uint32_t) rand() << 16 ^ (uint32_t) rand()) >> (rand() % 32);
+        uint64_t product = (uint64_t) a * b;
+        uint32_t expected = 0;
+
+        sensor_math_mul32(a, b, &high, &low);
+        host_check(high == (uint32_t) (product >> 32) && low == (uint32_t) product, "sensor_math_mul32");
+
+        if(c == 0 || product / c > 0xffffffffULL){
+            expected = SENSOR_MATH_INFINITY;
+        }
+        else{
+            expected = (uint32_t) (product / c);
+        }
+        host_check(sensor_math_muldiv(a, b, c) == expected, "sensor_math_muldiv");
+    }
+}
+
+/* R_SENSOR = R_LOW_SIDE * (SENSOR_VCC * 2^bits - ADC_VCC * ADC) / (ADC_VCC * ADC), the firmware
+ * rounds down to a whole ohm so it has to be within one ohm below the exact value. The independent
+ * variable R_SENSOR / R0 * scaler inverse gets rounded down once more, on top of the ohm already lost */
+static void test_resistance(void){
+    uint32_t checked = 0;
+
+    for(uint8_t sensor_index = 0; sensor_index < 2; sensor_index++){
+        double sensor_vcc = get_sensor_vcc(sensor_index);
+        double scaler_inverse = get_independent_scaler_inverse(sensor_index);
+
+        for(uint8_t range_index = 0; range_index < 3; range_index++){
+            uint32_t r_low = low_side_resistance(sensor_index, range_index);
+
+            for(uint8_t oversampling = 0; oversampling <= SAMPLER_MAX_OVERSAMPLING; oversampling++){
+                uint8_t adc_bits = 10 + oversampling;
+                double full_scale = ldexp(1.0, adc_bits);
+
+                for(uint32_t adc_value = 0; adc_value < (1UL << adc_bits); adc_value++){
+                    uint32_t resistance = sensor_math_resistance(adc_value, adc_bits, r_low,
+                            get_sensor_vcc(sensor_index), ADC_VCC_TENTH_VOLTS);
+                    double a = (double) adc_value * ADC_VCC_TENTH_VOLTS;
+                    double b = full_scale * sensor_vcc;
+                    double expected = 0;
+
+                    checked++;
+                    if(adc_value == 0){
+                        host_check(resistance == SENSOR_MATH_INFINITY, "an open circuit should read as infinity");
+                        continue;
+                    }
+                    if(a >= b){
+                        host_check(resistance == 0, "a reading past full scale should read as a short");
+                        continue;
+                    }
+
+                    expected = r_low * (b - a) / a;
+                    if(expected >= 4294967295.0){
+                        host_check(resistance == SENSOR_MATH_INFINITY, "a resistance past 32 bits should saturate");
+                        continue;
+                    }
+                    if(!(resistance <= expected + SLACK && expected < resistance + 1.0)){
+                        fprintf(stderr, "sensor %u range %u bits %u adc %lu: %lu ohms, expected %.3f\n",
+                                sensor_index, range_index, adc_bits, (unsigned long) adc_value,
+                                (unsigned long) resistance, expected);
+                        host_check(0, "resistance more than an ohm off");
+                        continue;
+                    }
+
+                    for(uint8_t ii = 0; ii < NUM_R0; ii++){
+                        uint32_t independent = sensor_math_independent(resistance, scaler_inverse, r0_ohms[ii]);
+                        double expected_independent = expected / r0_ohms[ii] * scaler_inverse;
+                        double tolerance = scaler_inverse / r0_ohms[ii] + 1.0;
+
+                        if(expected_independent >= 4294967295.0){
+                            host_check(independent == SENSOR_MATH_INFINITY || independent + tolerance >= 4294967295.0,
+                                    "an independent value past 32 bits should saturate");
+                            continue;
+                        }
+                        host_check(independent <= expected_independent + SLACK && expected_independent < independent + tolerance,
+                                "independent value off by more than the rounding");
+                    }
+                }
+            }
+        }
+    }
+
+    printf("test_sensor_math: %lu readings checked\n", (unsigned long) checked);
+}
+
+int main(void){
+    test_kernel();
+    test_resistance();
+    return host_result("test_sensor_math");
+}
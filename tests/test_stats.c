@@ -0,0 +1,163 @@
+/*
+ * test_stats.c
+ *
+ *  the running statistics against a double precision reference: mean and variance
+ *  over runs of computed values with all sorts of spreads, the window starting over,
+ *  and the snapshot restarting the window as it is read
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include "host.h"
+#include "stats.h"
+#include "egg_bus.h"
+
+#define MAX_SAMPLES 2000
+
+static uint16_t samples[MAX_SAMPLES];
+static double worst_mean_error;   // as a fraction of the bound
+
+static uint16_t big_endian_16(const uint8_t * buffer){
+    return ((uint16_t) buffer[0] << 8) | buffer[1];
+}
+
+static uint32_t big_endian_32(const uint8_t * buffer){
+    return ((uint32_t) big_endian_16(buffer) << 16) | big_endian_16(buffer + 2);
+}
+
+/* the mean is carried in Q8 and every sample's division by n truncates, losing under 1/256.
+ * the loss in sample k is scaled by k / n by the end of the run, so the mean can be up to
+ * (n + 1) / 512 off after n samples, which is only reached when every sample loses the most.
+ * the variance picks up a small relative error from that */
+static void check_against_reference(uint16_t count, const char * what){
+    stats_summary_t summary;
+    double mean = 0;
+    double variance = 0;
+    uint16_t min = 0xffff;
+    uint16_t max = 0;
+
+    for(uint16_t ii = 0; ii < count; ii++){
+        mean += samples[ii];
+        min = samples[ii] < min ? samples[ii] : min;
+        max = samples[ii] > max ? samples[ii] : max;
+    }
+    mean /= count;
+    for(uint16_t ii = 0; ii < count; ii++){
+        variance += (samples[ii] - mean) * (samples[ii] - mean);
+    }
+    variance /= count;
+
+    stats_get_summary(0, &summary, 0);
+    host_check(summary.count == count, what);
+    host_check(summary.min == min && summary.max == max, what);
+    host_check(fabs(summary.mean_q8 / 256.0 - mean) <= (count + 1) / 512.0, what);
+    if(fabs(summary.mean_q8 / 256.0 - mean) / ((count + 1) / 512.0) > worst_mean_error){
+        worst_mean_error = fabs(summary.mean_q8 / 256.0 - mean) / ((count + 1) / 512.0);
+    }
+    if(variance * 256 < 0xffffffff){
+        host_check(fabs(summary.variance_q8 / 256.0 - variance) <= 1e-4 * variance + 1.0 / 16, what);
+    }
+    else{
+        host_check(summary.variance_q8 == 0xffffffff, "the variance should saturate");
+    }
+}
+
+static void run(uint16_t count){
+    stats_set_window(0, 0);
+    for(uint16_t ii = 0; ii < count; ii++){
+        stats_update(0, samples[ii]);
+    }
+}
+
+// noise of every size around every level, including the full 16-bit range
+static void test_against_reference(void){
+    static const uint16_t levels[] = { 0, 7, 1000, 30000, 65000 };
+    static const uint16_t spreads[] = { 0, 1, 16, 1000, 30000 };
+
+    srand(12);
+    for(uint8_t ii = 0; ii < sizeof(levels) / sizeof(levels[0]); ii++){
+        for(uint8_t jj = 0; jj < sizeof(spreads) / sizeof(spreads[0]); jj++){
+            for(uint16_t kk = 0; kk < MAX_SAMPLES; kk++){
+                int32_t x = (int32_t) levels[ii] + (spreads[jj] ? rand() % (2 * spreads[jj] + 1) - spreads[jj] : 0);
+                samples[kk] = x < 0 ? 0 : x > 0xffff ? 0xffff : (uint16_t) x;
+            }
+            run(1);
+            check_against_reference(1, "a single sample");
+            run(10);
+            check_against_reference(10, "ten samples");
+            run(MAX_SAMPLES);
+            check_against_reference(MAX_SAMPLES, "a long run");
+        }
+    }
+
+    // a slow drift, where the mean moves a long way over the run
+    for(uint16_t kk = 0; kk < MAX_SAMPLES; kk++){
+        samples[kk] = 100 + 30 * kk;
+    }
+    run(MAX_SAMPLES);
+    check_against_reference(MAX_SAMPLES, "a drift");
+    printf("test_stats: the mean came within %.0f%% of its error bound at worst\n", 100 * worst_mean_error);
+}
+
+// values that don't fit in 16 bits count as 0xffff
+static void test_saturation(void){
+    stats_summary_t summary;
+    stats_set_window(0, 0);
+    stats_update(0, 100000);
+    stats_update(0, 0xffff);
+    stats_get_summary(0, &summary, 0);
+    host_check(summary.max == 0xffff && summary.mean_q8 == 0xffffUL << 8 && summary.variance_q8 == 0, "a value over 16 bits didn't saturate");
+}
+
+// a full window starts over with the next sample
+static void test_window(void){
+    stats_summary_t summary;
+    stats_set_window(0, 5);
+    for(uint16_t ii = 0; ii < 5; ii++){
+        stats_update(0, 10);
+    }
+    stats_get_summary(0, &summary, 0);
+    host_check(summary.count == 5 && summary.mean_q8 == 10 << 8, "the window didn't fill");
+
+    stats_update(0, 20);
+    stats_get_summary(0, &summary, 0);
+    host_check(summary.count == 1 && summary.min == 20 && summary.max == 20 && summary.mean_q8 == 20 << 8,
+            "the window didn't start over");
+    host_check(stats_get_window(0) == 5, "window read back wrong");
+}
+
+// the snapshot is the whole summary, big endian, and the next sample starts a new window
+static void test_snapshot(void){
+    uint8_t buffer[STATS_SNAPSHOT_LENGTH];
+    stats_summary_t summary;
+
+    stats_set_window(0, 0);
+    stats_update(0, 4);
+    stats_update(0, 8);
+    stats_copy_snapshot(0, buffer);
+    host_check(big_endian_16(buffer) == 4 && big_endian_16(buffer + 2) == 8, "snapshot min and max");
+    host_check(big_endian_32(buffer + 4) == 2, "snapshot count");
+    host_check(big_endian_32(buffer + 8) == 6 << 8, "snapshot mean");
+    host_check(big_endian_32(buffer + 12) == 4 << 8, "snapshot variance");
+
+    stats_get_summary(0, &summary, 0);
+    host_check(summary.count == 0, "reading the snapshot didn't restart the window");
+    stats_update(0, 3);
+    stats_get_summary(0, &summary, 0);
+    host_check(summary.count == 1 && summary.min == 3, "the window after the snapshot kept old samples");
+
+    // the other sensor was left alone all along, and out of range sensors read as nothing
+    stats_get_summary(1, &summary, 0);
+    host_check(summary.count == 0, "the other sensor picked up samples");
+    stats_get_summary(EGG_BUS_NUM_HOSTED_SENSORS, &summary, 0);
+    host_check(summary.count == 0, "a sensor that doesn't exist has statistics");
+}
+
+int main(void){
+    test_against_reference();
+    test_saturation();
+    test_window();
+    test_snapshot();
+    return host_result("test_stats");
+}
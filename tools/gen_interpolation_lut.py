@@ -0,0 +1,201 @@
+#!/usr/bin/env python
+"""
+gen_interpolation_lut.py
+
+Generates src/interpolation_lut.h from the response curve tables and scalers
+in src/interpolation.c. Run it from the repository root whenever those change:
+
+    python tools/gen_interpolation_lut.py
+
+The curve is the one the master computes from the mapping table and scaler
+registers: straight lines between the table points. The lookup table samples
+it at even steps of log2 of the independent variable, so the firmware gets
+from log2(R / R0) to ppb with one table read and one multiply-add. Each
+sensor gets the coarsest step (at most 1/16 of an octave) that keeps the
+table within MAX_ERROR_PERCENT of the linear interpolation, the steep CO
+curve needs a finer one than NO2. tests/test_interpolation checks the
+firmware against the same tolerance.
+
+A report is printed on stdout with the error of the lookup table against the
+linear table interpolation, and against a curve that is straight in log-log
+space for comparison (the MOx responses are close to power laws, but the
+master doesn't know that).
+"""
+
+import math
+import os
+import re
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+SOURCE = os.path.join(ROOT, 'src', 'interpolation.c')
+TARGET = os.path.join(ROOT, 'src', 'interpolation_lut.h')
+
+SENSORS = [('no2', 'no2_ppb'), ('co', 'co_ppb')]
+LOG2_Q = 12                # log2 values are fixed point with 12 fractional bits
+LOG2_FRACTION_BITS = 4     # the mantissa lookup has 2^4 + 1 entries
+MAX_STEP_SHIFT = 8         # 2^8 Q12 units = 1/16 of an octave
+MIN_STEP_SHIFT = 5
+MAX_ERROR_PERCENT = 4.0  # keep in step with tests/test_interpolation.c
+
+
+def parse_table(source, name):
+    body = re.search(r'%s\[\]\[2\](?:\s+PROGMEM)?\s*=\s*\{(.*?)\};' % name, source, re.S).group(1)
+    points = [(int(x), int(y)) for x, y in re.findall(r'\{\s*(\d+)\s*,\s*(\d+)\s*\}', body)]
+    return points
+
+
+def parse_array(source, name, cast):
+    body = re.search(r'%s\[EGG_BUS_NUM_HOSTED_SENSORS\](?:\s+PROGMEM)?\s*=\s*\{(.*?)\};' % name, source, re.S).group(1)
+    return [cast(v.strip().rstrip('fF')) for v in body.split(',')]
+
+
+def log_log_ppb(points, x):
+    """the curve through the table points, piecewise straight in log-log space"""
+    if x <= points[0][0]:
+        return points[0][1]
+    for (x0, y0), (x1, y1) in zip(points, points[1:]):
+        if x <= x1:
+            t = math.log(x / x0) / math.log(x1 / x0)
+            return math.exp(math.log(y0) + t * (math.log(y1) - math.log(y0)))
+    return points[-1][1]
+
+
+def linear_ppb(points, x):
+    """straight lines between the table points, what the master computes from the table registers"""
+    if x <= points[0][0]:
+        return points[0][1]
+    for (x0, y0), (x1, y1) in zip(points, points[1:]):
+        if x <= x1:
+            return y0 + (y1 - y0) * (x - x0) / (x1 - x0)
+    return points[-1][1]
+
+
+def firmware_log2(value, fraction_table):
+    """bit-exact model of interpolation_log2 in interpolation.c"""
+    msb = value.bit_length() - 1
+    normalized = (value << (31 - msb)) & 0xffffffff
+    fraction = (normalized >> (31 - LOG2_Q)) & ((1 << LOG2_Q) - 1)
+    index = fraction >> (LOG2_Q - LOG2_FRACTION_BITS)
+    remainder = fraction & ((1 << (LOG2_Q - LOG2_FRACTION_BITS)) - 1)
+    low = fraction_table[index]
+    high = fraction_table[index + 1]
+    return (msb << LOG2_Q) + low + (((high - low) * remainder) >> (LOG2_Q - LOG2_FRACTION_BITS))
+
+
+def firmware_lut_ppb(lut, base, step_shift, value, fraction_table):
+    """bit-exact model of interpolation_compute_ppb in interpolation.c"""
+    last = (len(lut) - 1) << step_shift
+    position = firmware_log2(value, fraction_table) - base if value else 0
+    position = min(max(position, 0), last)
+    index = position >> step_shift
+    if position == last:
+        return lut[index]
+    step = position & ((1 << step_shift) - 1)
+    delta = lut[index + 1] - lut[index]
+    # C division truncates towards zero
+    offset = abs(delta * step) >> step_shift
+    return lut[index] + (offset if delta >= 0 else -offset)
+
+
+def build_lut(points, step_shift):
+    first = int(math.floor(math.log(points[0][0], 2) * (1 << LOG2_Q)))
+    last = int(math.ceil(math.log(points[-1][0], 2) * (1 << LOG2_Q)))
+    length = ((last - first) >> step_shift) + 2
+    lut = [int(round(linear_ppb(points, 2.0 ** (float(first + (ii << step_shift)) / (1 << LOG2_Q)))))
+           for ii in range(length)]
+    return first, lut
+
+
+def measure_error(points, first, lut, step_shift, fraction_table, reference):
+    """worst and mean percentage error over the table's range of independent values"""
+    worst = 0.0
+    total = 0.0
+    count = 0
+    x = points[0][0]
+    while x <= points[-1][0]:
+        value = int(x)
+        expected = reference(points, value)
+        got = firmware_lut_ppb(lut, first, step_shift, value, fraction_table)
+        error = abs(got - expected) / expected * 100.0
+        worst = max(worst, error)
+        total += error
+        count += 1
+        x *= 1.0003
+    return worst, total / count
+
+
+def main():
+    source = open(SOURCE).read()
+    x_scaler = parse_array(source, 'x_scaler', float)
+    y_scaler = parse_array(source, 'y_scaler', float)
+    inverse = parse_array(source, 'independent_scaler_inverse', int)
+
+    entries = 1 << LOG2_FRACTION_BITS
+    fraction_table = [int(round(math.log(1.0 + float(i) / entries, 2) * (1 << LOG2_Q)))
+                      for i in range(entries + 1)]
+
+    luts = []
+    for sensor_index, (short_name, table_name) in enumerate(SENSORS):
+        points = parse_table(source, table_name)
+        points = [(x * x_scaler[sensor_index] * inverse[sensor_index], y * y_scaler[sensor_index])
+                  for x, y in points if x != 0xff]
+
+        # the coarsest step that is good enough
+        for step_shift in range(MAX_STEP_SHIFT, MIN_STEP_SHIFT - 1, -1):
+            first, lut = build_lut(points, step_shift)
+            worst, mean = measure_error(points, first, lut, step_shift, fraction_table, linear_ppb)
+            if worst <= MAX_ERROR_PERCENT:
+                break
+        else:
+            sys.exit('%s: no step size gets within %.1f%%' % (short_name, MAX_ERROR_PERCENT))
+        luts.append((short_name, first, step_shift, lut))
+
+        log_log_worst, log_log_mean = measure_error(points, first, lut, step_shift, fraction_table, log_log_ppb)
+        sys.stdout.write('%-4s %3d entries, 1/%d octave apart\n' % (short_name, len(lut), (1 << LOG2_Q) >> step_shift))
+        sys.stdout.write('     vs linear interpolation: mean %5.2f%% max %5.2f%%\n' % (mean, worst))
+        sys.stdout.write('     vs log-log curve:        mean %5.2f%% max %5.2f%%\n' % (log_log_mean, log_log_worst))
+
+    out = []
+    out.append('/*')
+    out.append(' * interpolation_lut.h')
+    out.append(' *')
+    out.append(' *  Generated by tools/gen_interpolation_lut.py from the tables in interpolation.c')
+    out.append(' *  do not edit by hand, re-run the script instead')
+    out.append(' */')
+    out.append('')
+    out.append('#ifndef INTERPOLATION_LUT_H_')
+    out.append('#define INTERPOLATION_LUT_H_')
+    out.append('')
+    out.append('#include <stdint.h>')
+    out.append('#include <avr/pgmspace.h>')
+    out.append('')
+    out.append('#define INTERPOLATION_LOG2_Q %d // log2 values carry %d fractional bits' % (LOG2_Q, LOG2_Q))
+    out.append('#define INTERPOLATION_LOG2_FRACTION_BITS %d' % LOG2_FRACTION_BITS)
+    out.append('')
+    out.append('// log2(1 + i / %d) scaled by 2^%d' % (entries, LOG2_Q))
+    out.append('static const uint16_t interpolation_log2_fraction[%d] PROGMEM = {' % len(fraction_table))
+    out.append('        ' + ', '.join(str(v) for v in fraction_table))
+    out.append('};')
+    for short_name, first, step_shift, lut in luts:
+        name = short_name.upper()
+        out.append('')
+        out.append('// ppb, starting at log2(independent value) = %d / 2^%d and stepping 1/%d of an octave'
+                   % (first, LOG2_Q, (1 << LOG2_Q) >> step_shift))
+        out.append('#define INTERPOLATION_LUT_%s_LOG2_BASE %dL' % (name, first))
+        out.append('#define INTERPOLATION_LUT_%s_STEP_SHIFT %d' % (name, step_shift))
+        out.append('#define INTERPOLATION_LUT_%s_LENGTH %d' % (name, len(lut)))
+        out.append('static const uint16_t %s_ppb_lut[INTERPOLATION_LUT_%s_LENGTH] PROGMEM = {' % (short_name, name))
+        for ii in range(0, len(lut), 8):
+            out.append('        ' + ', '.join(str(v) for v in lut[ii:ii + 8]) + ',')
+        out[-1] = out[-1].rstrip(',')
+        out.append('};')
+    out.append('')
+    out.append('#endif /* INTERPOLATION_LUT_H_ */')
+    out.append('')
+
+    open(TARGET, 'w').write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()